@@ -0,0 +1,821 @@
+#pragma once
+
+#include <any>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "array.hpp"
+#include "builtins.hpp"
+#include "errors.hpp"
+#include "map.hpp"
+#include "native.hpp"
+#include "number.hpp"
+#include "object.hpp"
+#include "runtime_error.hpp"
+
+/*
+  Runtime for programs translated by hd --emit-cpp, see cpp_emitter.hpp.
+  Values are the same std::any the interpreter uses, holding the same
+  numbers, strings, arrays and maps, and the natives are the interpreter's
+  own. Only the values that point back into the syntax tree there
+  (functions, classes, instances, bound methods and tasks) have compiled
+  counterparts here. Every check below raises the interpreter's error
+  message at the same line, and stringify() prints like it does, so a
+  compiled script's output is byte for byte the interpreter's.
+
+  Tasks run to completion right where they are spawned, with the globals
+  they can reach swapped for copies while they run. Their output is buffered and errors
+  held back until the await exactly as in the interpreter, so what a script
+  prints is the same, only nothing runs in parallel.
+*/
+namespace aot {
+
+struct Tail;
+struct Global;
+
+// a compiled function gets its frame (the receiver first for methods, then
+// the arguments) and may hand back a call in tail position through tail
+using Code = std::any (*)(std::any *frame, Tail &tail);
+
+// one per function declaration in the script
+struct FunctionInfo {
+    const char *name;
+    size_t arity;
+    Code code;
+    // the globals it and the functions declared in it mention, FunStmt::globals
+    Global *const *globals;
+    size_t globalCount;
+};
+
+// a function as a value, like LoxFunction it is just the declaration
+struct Function {
+    const FunctionInfo *info;
+
+    bool operator==(const Function& other) const {
+        return info == other.info;
+    }
+};
+
+// a call a function returned in tail position, made by invoke() in its frame
+struct Tail {
+    const FunctionInfo *callee = nullptr;
+    std::vector<std::any> args;
+};
+
+class Class;
+
+// a method and the class whose declaration it came from, like the interpreter's Method
+struct Method {
+    const FunctionInfo *info = nullptr;
+    Class *owner = nullptr;
+};
+
+// properties are numbered when the script is translated, the names are only kept for errors
+class Class {
+public:
+    std::string name;
+    Class *superclass;
+
+    // own and inherited methods, flattened when the class is created
+    std::unordered_map<int, Method> methods;
+    Method initializer;
+
+    Class(std::string name, Class *superclass) : name(std::move(name)), superclass(superclass) {
+        if (superclass) methods = superclass->methods;
+    }
+
+    Method findMethod(int property) const {
+        auto it = methods.find(property);
+        return it == methods.end() ? Method() : it->second;
+    }
+};
+
+class Instance : public Object {
+public:
+    Class *klass;
+    // instances have a handful of fields, a scan beats hashing
+    std::vector<std::pair<int, std::any>> fields;
+
+    Instance(Class *klass) : klass(klass) {}
+
+    std::any* field(int property) {
+        for (auto &[id, value] : fields) {
+            if (id == property) return &value;
+        }
+        return nullptr;
+    }
+};
+
+class BoundMethod : public Object {
+public:
+    Ref<Instance> receiver;
+    Method method;
+
+    BoundMethod(Ref<Instance> receiver, Method method) : receiver(std::move(receiver)), method(method) {}
+};
+
+class Task : public Object {
+public:
+    std::ostringstream output;
+    std::any result;
+    std::optional<RuntimeError> error;
+    bool awaited = false;
+};
+
+// a global variable, it only exists once something defined it
+struct Global {
+    const char *name;
+    std::any value;
+    bool defined = false;
+
+    Global(const char *name, std::any value = std::any()) : name(name), value(std::move(value)), defined(this->value.has_value()) {}
+
+    const std::any& get(int line) const {
+        if (!defined) throw RuntimeError(line, "Undefined variable '" + std::string(name) + "'.");
+        return value;
+    }
+
+    void define(std::any initial) {
+        value = std::move(initial);
+        defined = true;
+    }
+
+    const std::any& assign(std::any next, int line) {
+        if (!defined) throw RuntimeError(line, "Undefined variable '" + std::string(name) + "'.");
+        value = std::move(next);
+        return value;
+    }
+};
+
+// what the script and each task running inside it have to themselves
+struct Context {
+    std::ostream *out;
+    bool inTask;
+    size_t depth = 0;
+    // the class that declared the running method, 'super' searches its superclass
+    Class *methodClass = nullptr;
+    // tasks spawned from here, finished before the script or the task ends
+    std::vector<Ref<Task>> spawned;
+
+    Context(std::ostream *out, bool inTask) : out(out), inTask(inTask) {}
+};
+
+inline Context *context = nullptr;
+inline size_t maxCallDepth = 1000;
+
+// every class ever declared, referenced by raw pointer from values like in the interpreter
+inline std::vector<std::unique_ptr<Class>> classes;
+
+/* Values */
+
+// the builtin of that name, as the global the interpreter starts with
+inline std::any native(const std::string& name) {
+    for (auto list : { &builtins::natives(), &array::natives(), &map::natives() }) {
+        for (auto &def : *list) {
+            if (def.name == name) return LoxNative{ &def };
+        }
+    }
+    return std::any();
+}
+
+inline Ref<LoxArray> array(size_t size) {
+    auto result = make<LoxArray>();
+    result->numbers.reserve(size);
+    return result;
+}
+
+inline bool isTrue(const std::any& value) {
+    if (auto flag = std::any_cast<bool>(&value)) return *flag;
+    return false;
+}
+
+inline bool isEqual(const std::any& left, const std::any& right) {
+    if (!left.has_value() && !right.has_value()) return true;
+
+    if (!left.has_value()) return false;
+
+    double x, y;
+    if (number::get(left, x) && number::get(right, y)) return x == y;
+
+    if (left.type() != right.type()) return false;
+
+    if (auto a = std::any_cast<bool>(&left)) return *a == *std::any_cast<bool>(&right);
+    if (auto a = std::any_cast<std::string>(&left)) return *a == *std::any_cast<std::string>(&right);
+    if (auto a = std::any_cast<Function>(&left)) return *a == *std::any_cast<Function>(&right);
+    if (auto a = std::any_cast<LoxNative>(&left)) return *a == *std::any_cast<LoxNative>(&right);
+    if (auto a = std::any_cast<Ref<LoxArray>>(&left)) return *a == *std::any_cast<Ref<LoxArray>>(&right);
+    if (auto a = std::any_cast<Ref<LoxMap>>(&left)) return *a == *std::any_cast<Ref<LoxMap>>(&right);
+    if (auto a = std::any_cast<Ref<Task>>(&left)) return *a == *std::any_cast<Ref<Task>>(&right);
+    if (auto a = std::any_cast<Class*>(&left)) return *a == *std::any_cast<Class*>(&right);
+    if (auto a = std::any_cast<Ref<Instance>>(&left)) return *a == *std::any_cast<Ref<Instance>>(&right);
+    if (auto a = std::any_cast<Ref<BoundMethod>>(&left)) return *a == *std::any_cast<Ref<BoundMethod>>(&right);
+
+    return false;
+}
+
+inline std::string stringify(const std::any& object) {
+    if (!object.has_value() || object.type() == typeid(nullptr_t)) return "nil";
+
+    if (auto function = std::any_cast<Function>(&object)) return "<fn " + std::string(function->info->name) + ">";
+
+    if (auto native = std::any_cast<LoxNative>(&object)) return "<native fn " + native->def->name + ">";
+
+    if (auto array = std::any_cast<Ref<LoxArray>>(&object)) {
+        std::string result = "[";
+
+        for (size_t i = 0; i < (*array)->size(); i++) {
+            if (i) result += ", ";
+            result += stringify((*array)->get(i));
+        }
+
+        return result + "]";
+    }
+
+    if (auto map = std::any_cast<Ref<LoxMap>>(&object)) {
+        std::string result = "{";
+
+        for (auto &entry : (*map)->entries) {
+            if (entry.distance < 0) continue;
+            if (result.size() > 1) result += ", ";
+            result += stringify(map::keyValue(entry.key)) + ": " + stringify(entry.value);
+        }
+
+        return result + "}";
+    }
+
+    if (object.type() == typeid(Ref<Task>)) return "<task>";
+
+    if (auto klass = std::any_cast<Class*>(&object)) return (*klass)->name;
+
+    if (auto instance = std::any_cast<Ref<Instance>>(&object)) return (*instance)->klass->name + " instance";
+
+    if (auto bound = std::any_cast<Ref<BoundMethod>>(&object)) return "<fn " + std::string((*bound)->method.info->name) + ">";
+
+    double value;
+    if (number::get(object, value)) return std::to_string(value);
+
+    if (auto flag = std::any_cast<bool>(&object)) return *flag ? "true" : "false";
+
+    return *std::any_cast<std::string>(&object);
+}
+
+inline void print(const std::any& value) {
+    *context->out << stringify(value) << "\n";
+}
+
+/* Operators */
+
+inline std::pair<double, double> numberOperands(int line, const std::any& left, const std::any& right) {
+    double x, y;
+    if (number::get(left, x) && number::get(right, y)) return { x, y };
+
+    throw RuntimeError(line, "Operands must be a numbers");
+}
+
+// two integers stay on int64 exactly as in Interpreter::binary
+#define HD_AOT_COMPARISON(name, op)                                                         \
+    inline bool name(int line, const std::any& left, const std::any& right) {               \
+        auto a = std::any_cast<int64_t>(&left), b = std::any_cast<int64_t>(&right);         \
+        if (a && b) return *a op *b;                                                        \
+        auto [x, y] = numberOperands(line, left, right);                                    \
+        return x op y;                                                                      \
+    }
+
+HD_AOT_COMPARISON(greater, >)
+HD_AOT_COMPARISON(greaterEqual, >=)
+HD_AOT_COMPARISON(less, <)
+HD_AOT_COMPARISON(lessEqual, <=)
+
+#undef HD_AOT_COMPARISON
+
+inline std::any subtract(int line, const std::any& left, const std::any& right) {
+    auto a = std::any_cast<int64_t>(&left), b = std::any_cast<int64_t>(&right);
+    if (a && b) return number::subtract(*a, *b);
+
+    auto [x, y] = numberOperands(line, left, right);
+    return x - y;
+}
+
+inline std::any multiply(int line, const std::any& left, const std::any& right) {
+    auto a = std::any_cast<int64_t>(&left), b = std::any_cast<int64_t>(&right);
+    if (a && b) return number::multiply(*a, *b);
+
+    auto [x, y] = numberOperands(line, left, right);
+    return x * y;
+}
+
+inline std::any divide(int line, const std::any& left, const std::any& right) {
+    auto [x, y] = numberOperands(line, left, right);
+    return x / y;
+}
+
+inline std::any add(int line, const std::any& left, const std::any& right) {
+    auto a = std::any_cast<int64_t>(&left), b = std::any_cast<int64_t>(&right);
+    if (a && b) return number::add(*a, *b);
+
+    double x, y;
+    if (number::get(left, x) && number::get(right, y)) return x + y;
+
+    auto s = std::any_cast<std::string>(&left), t = std::any_cast<std::string>(&right);
+    if (s && t) return *s + *t;
+
+    throw RuntimeError(line, "Operands must be two strings or numbers");
+}
+
+inline std::any negate(int line, const std::any& operand) {
+    if (auto integer = std::any_cast<int64_t>(&operand)) return number::negate(*integer);
+
+    double value;
+    if (number::get(operand, value)) return -value;
+
+    throw RuntimeError(line, "Operand must be a number");
+}
+
+/* Calls */
+
+inline void checkArity(size_t arity, size_t count, int line) {
+    if (count == arity) return;
+
+    throw RuntimeError(line, "Expected " + std::to_string(arity) + " arguments but got " + std::to_string(count) + ".");
+}
+
+// runs a function on its frame, then any calls it makes in tail position in the same C++ frame
+inline std::any invoke(const FunctionInfo *function, std::any *frame, int line) {
+    Context &current = *context;
+    if (current.depth >= maxCallDepth) {
+        throw RuntimeError(line, "Stack overflow: call depth exceeded " + std::to_string(maxCallDepth) + ".");
+    }
+
+    struct Leave {
+        size_t &depth;
+        ~Leave() { depth--; }
+    } leave{ ++current.depth };
+
+    Tail tail;
+    std::any result = function->code(frame, tail);
+
+    // the callee fills tail.args while it runs from the other vector, so neither is reallocated
+    std::vector<std::any> args;
+    while (tail.callee) {
+        function = tail.callee;
+        tail.callee = nullptr;
+        args.swap(tail.args);
+
+        result = function->code(args.data(), tail);
+    }
+
+    return result;
+}
+
+inline std::any callNative(const NativeDef *native, std::any *args, size_t count, int line) {
+    // number to number natives are called directly, with the interpreter's checks
+    if (native->unary && count == 1) {
+        double x;
+        if (!number::get(args[0], x)) throw RuntimeError(line, "Expected a number.");
+        return native->unary(x);
+    }
+
+    if (native->binary && count == 2) {
+        double x, y;
+        bool numbers = number::get(args[0], x);
+        numbers = number::get(args[1], y) && numbers;
+        if (!numbers) throw RuntimeError(line, "Expected a number.");
+        return native->binary(x, y);
+    }
+
+    checkArity(native->arity, count, line);
+    return native->function(args, Mark(TokenType::RIGHT_PAREN, line));
+}
+
+// a method with the receiver put in slot 0 of its frame, args[1...] are the arguments
+inline std::any invokeMethod(const Ref<Instance>& receiver, Method method, std::any *args, size_t count, int line) {
+    args[0] = receiver;
+    checkArity(method.info->arity, count, line);
+
+    struct Leave {
+        Class *&methodClass;
+        Class *caller;
+        ~Leave() { methodClass = caller; }
+    } leave{ context->methodClass, context->methodClass };
+    context->methodClass = method.owner;
+
+    return invoke(method.info, args, line);
+}
+
+// super.name(...), the receiver is the method's own 'this'
+inline std::any invokeSuper(int line, const std::any& receiver, Method method, std::any *args, size_t count) {
+    return invokeMethod(*std::any_cast<Ref<Instance>>(&receiver), method, args, count, line);
+}
+
+// args[0] is left free for a receiver, the arguments are args[1...]
+inline std::any call(int line, const std::any& callee, std::any *args, size_t count) {
+    if (auto function = std::any_cast<Function>(&callee)) {
+        checkArity(function->info->arity, count, line);
+        return invoke(function->info, args + 1, line);
+    }
+
+    if (auto native = std::any_cast<LoxNative>(&callee)) return callNative(native->def, args + 1, count, line);
+
+    if (auto klass = std::any_cast<Class*>(&callee)) {
+        auto instance = make<Instance>(*klass);
+
+        if ((*klass)->initializer.info) {
+            invokeMethod(instance, (*klass)->initializer, args, count, line);
+            return instance;
+        }
+
+        if (count != 0) throw RuntimeError(line, "Expected 0 arguments but got " + std::to_string(count) + ".");
+        return instance;
+    }
+
+    if (auto bound = std::any_cast<Ref<BoundMethod>>(&callee)) {
+        Ref<BoundMethod> method = *bound;
+        return invokeMethod(method->receiver, method->method, args, count, line);
+    }
+
+    throw RuntimeError(line, "Can only call functions and classes.");
+}
+
+// return f(...) in tail position: a function is left for invoke() to run in this frame
+inline std::any tailCall(Tail &tail, int line, const std::any& callee, std::any *args, size_t count) {
+    if (auto function = std::any_cast<Function>(&callee)) {
+        checkArity(function->info->arity, count, line);
+
+        tail.callee = function->info;
+        tail.args.clear();
+        for (size_t i = 1; i <= count; i++) tail.args.push_back(std::move(args[i]));
+        return std::any();
+    }
+
+    return call(line, callee, args, count);
+}
+
+/* Classes and instances */
+
+inline void checkClass(int line) {
+    // like the interpreter, which keeps its inline caches on the shared syntax tree
+    if (context->inTask) throw RuntimeError(line, "Can't declare a class inside a task.");
+}
+
+inline Class* superclass(int line, const std::any& value) {
+    if (auto klass = std::any_cast<Class*>(&value)) return *klass;
+    throw RuntimeError(line, "Superclass must be a class.");
+}
+
+inline Class* declareClass(const char *name, Class *superclass, std::initializer_list<std::pair<int, const FunctionInfo*>> methods, int init) {
+    classes.push_back(std::make_unique<Class>(name, superclass));
+    Class *klass = classes.back().get();
+
+    for (auto &[property, method] : methods) klass->methods[property] = Method{ method, klass };
+    klass->initializer = klass->findMethod(init);
+
+    return klass;
+}
+
+// what obj.name found, for a call through it
+struct Property {
+    Ref<Instance> receiver;
+    Method method;
+    std::any field;
+};
+
+inline const Ref<Instance>& instance(int line, const std::any& object, const char *error) {
+    if (auto instance = std::any_cast<Ref<Instance>>(&object)) return *instance;
+    throw RuntimeError(line, error);
+}
+
+inline Property property(int line, const std::any& object, int property, const char *name) {
+    const Ref<Instance> &receiver = instance(line, object, "Only instances have properties.");
+    if (std::any *field = receiver->field(property)) return { receiver, Method(), *field };
+
+    Method method = receiver->klass->findMethod(property);
+    if (!method.info) throw RuntimeError(line, "Undefined property '" + std::string(name) + "'.");
+
+    return { receiver, method, std::any() };
+}
+
+inline std::any callProperty(int line, Property& found, std::any *args, size_t count) {
+    if (found.method.info) return invokeMethod(found.receiver, found.method, args, count, line);
+    return call(line, found.field, args, count);
+}
+
+inline std::any get(int line, const std::any& object, int property, const char *name) {
+    Property found = aot::property(line, object, property, name);
+    if (found.method.info) return make<BoundMethod>(found.receiver, found.method);
+    return found.field;
+}
+
+inline Ref<Instance> fields(int line, const std::any& object) {
+    return instance(line, object, "Only instances have fields.");
+}
+
+inline const std::any& set(const Ref<Instance>& instance, int property, std::any value) {
+    if (std::any *field = instance->field(property)) {
+        *field = std::move(value);
+        return *field;
+    }
+
+    instance->fields.emplace_back(property, std::move(value));
+    return instance->fields.back().second;
+}
+
+// the method super.name finds, super only appears right in a method's body
+inline Method superMethod(int property, const char *name, int line) {
+    Method method = context->methodClass->superclass->findMethod(property);
+    if (!method.info) throw RuntimeError(line, "Undefined property '" + std::string(name) + "'.");
+    return method;
+}
+
+inline std::any bind(const std::any& receiver, Method method) {
+    return make<BoundMethod>(*std::any_cast<Ref<Instance>>(&receiver), method);
+}
+
+/* Arrays and maps */
+
+inline void indexable(int line, const std::any& object) {
+    if (object.type() != typeid(Ref<LoxArray>) && object.type() != typeid(Ref<LoxMap>)) {
+        throw RuntimeError(line, "Only arrays and maps can be indexed.");
+    }
+}
+
+inline size_t position(int line, const std::any& value, LoxArray *array) {
+    if (auto integer = std::any_cast<int64_t>(&value)) {
+        if (*integer < 0 || static_cast<uint64_t>(*integer) >= array->size()) throw RuntimeError(line, "Array index out of bounds.");
+        return static_cast<size_t>(*integer);
+    }
+
+    auto real = std::any_cast<double>(&value);
+    if (!real || *real != std::floor(*real)) throw RuntimeError(line, "Array index must be an integer.");
+    if (*real < 0 || *real >= array->size()) throw RuntimeError(line, "Array index out of bounds.");
+
+    return static_cast<size_t>(*real);
+}
+
+inline MapKey key(int line, const std::any& value) {
+    try {
+        return map::key(value);
+    } catch (NativeError &e) {
+        throw RuntimeError(line, e.what());
+    }
+}
+
+// a literal string key is interned once, when the program starts
+inline std::any index(int line, const std::any& object, const std::any& index, const MapKey *literal = nullptr) {
+    if (auto array = std::any_cast<Ref<LoxArray>>(&object)) return (*array)->get(position(line, index, array->get()));
+
+    indexable(line, object);
+
+    // missing keys read as nil
+    LoxMap::Entry *entry = (*std::any_cast<Ref<LoxMap>>(&object))->find(literal ? *literal : key(line, index));
+    return entry ? entry->value : std::any();
+}
+
+// where an assignment to object[index] goes; map keys are checked before the
+// value is evaluated. A string key's text is the one in index
+struct Target {
+    Ref<LoxArray> array;
+    std::any index;
+    Ref<LoxMap> map;
+    MapKey key;
+};
+
+inline Target target(int line, const std::any& object, const std::any& index, const MapKey *literal = nullptr) {
+    if (auto array = std::any_cast<Ref<LoxArray>>(&object)) return { *array, index, Ref<LoxMap>(), MapKey() };
+
+    indexable(line, object);
+    if (literal) return { Ref<LoxArray>(), std::any(), *std::any_cast<Ref<LoxMap>>(&object), *literal };
+    return { Ref<LoxArray>(), index, *std::any_cast<Ref<LoxMap>>(&object), key(line, index) };
+}
+
+inline const std::any& store(int line, Target& target, const std::any& value) {
+    if (target.array) {
+        target.array->set(position(line, target.index, target.array.get()), value);
+        return value;
+    }
+
+    // the key was made from the index passed to target(), this copy of it is the one still alive
+    if (target.key.text && !target.key.symbol) target.key.text = std::any_cast<std::string>(&target.index);
+    target.map->set(target.key, value);
+
+    return value;
+}
+
+/* Tasks */
+
+// what a spawn copied so far, and the functions it met on the way: the task
+// can call those and so reach the globals they mention
+struct Copies {
+    std::unordered_map<const Object*, std::any> objects;
+    std::vector<const FunctionInfo*> functions;
+};
+
+// the deep copy Interpreter::send makes, false for values that can't cross into a task
+inline bool send(const std::any& value, std::any& copy, Copies& copies) {
+    if (auto function = std::any_cast<Function>(&value)) {
+        copies.functions.push_back(function->info);
+        copy = value;
+        return true;
+    }
+
+    if (!value.has_value() || value.type() == typeid(nullptr_t) || number::is(value) ||
+        value.type() == typeid(bool) || value.type() == typeid(std::string) ||
+        value.type() == typeid(LoxNative)) {
+        copy = value;
+        return true;
+    }
+
+    if (auto array = std::any_cast<Ref<LoxArray>>(&value)) {
+        if (auto seen = copies.objects.find(array->get()); seen != copies.objects.end()) {
+            copy = seen->second;
+            return true;
+        }
+
+        auto result = make<LoxArray>();
+        copies.objects[array->get()] = result;
+
+        result->packed = (*array)->packed;
+        result->numbers = (*array)->numbers;
+        for (auto &element : (*array)->values) {
+            result->values.emplace_back();
+            if (!send(element, result->values.back(), copies)) return false;
+        }
+
+        copy = result;
+        return true;
+    }
+
+    if (auto map = std::any_cast<Ref<LoxMap>>(&value)) {
+        if (auto seen = copies.objects.find(map->get()); seen != copies.objects.end()) {
+            copy = seen->second;
+            return true;
+        }
+
+        auto result = make<LoxMap>();
+        copies.objects[map->get()] = result;
+
+        result->count = (*map)->count;
+        result->entries.resize((*map)->entries.size());
+        for (size_t i = 0; i < result->entries.size(); i++) {
+            auto &from = (*map)->entries[i];
+            auto &to = result->entries[i];
+
+            to.key = LoxMap::keep(from.key);
+            to.distance = from.distance;
+            if (!send(from.value, to.value, copies)) return false;
+        }
+
+        copy = result;
+        return true;
+    }
+
+    return false;
+}
+
+inline const FunctionInfo* spawnable(int line, const std::any& callee) {
+    if (auto function = std::any_cast<Function>(&callee)) return function->info;
+    throw RuntimeError(line, "Can only spawn functions.");
+}
+
+inline std::any sendArgument(int line, const std::any& value, Copies& copies) {
+    std::any copy;
+    if (!send(value, copy, copies)) {
+        throw RuntimeError(line, "Only nil, booleans, numbers, strings, functions, arrays and maps can be passed to a task.");
+    }
+    return copy;
+}
+
+inline std::any await(Task& task) {
+    if (!task.awaited) {
+        task.awaited = true;
+        *context->out << task.output.str();
+        task.output.str("");
+    }
+
+    if (task.error) throw *task.error;
+    return task.result;
+}
+
+inline std::any await(int line, const std::any& value) {
+    auto task = std::any_cast<Ref<Task>>(&value);
+    if (!task) throw RuntimeError(line, "Can only await tasks.");
+
+    return await(**task);
+}
+
+// tasks nobody awaited, their output and errors come out in spawn order
+inline void finishTasks(Context& current) {
+    for (auto &task : current.spawned) {
+        if (!task->awaited) await(*task);
+    }
+
+    current.spawned.clear();
+}
+
+inline std::any spawn(int line, const FunctionInfo *function, std::any *args, size_t count, Copies& copies) {
+    checkArity(function->arity, count, line);
+
+    // the task sees copies of the globals it can reach as they are now, minus
+    // the ones that can't be copied, like in Interpreter::visitSpawnExpr
+    struct Reached {
+        Global *global;
+        std::any value;
+        bool defined;
+    };
+    std::vector<Reached> reached;
+    std::unordered_set<const FunctionInfo*> visited;
+    std::unordered_set<const Global*> seen;
+
+    copies.functions.push_back(function);
+    while (!copies.functions.empty()) {
+        const FunctionInfo *next = copies.functions.back();
+        copies.functions.pop_back();
+        if (!visited.insert(next).second) continue;
+
+        for (size_t i = 0; i < next->globalCount; i++) {
+            Global *global = next->globals[i];
+            if (!seen.insert(global).second) continue;
+
+            std::any copy;
+            bool sent = global->defined && send(global->value, copy, copies);
+            reached.push_back({ global, std::move(copy), sent });
+        }
+    }
+    copies.objects.clear();
+
+    auto task = make<Task>();
+    Context &spawner = *context;
+
+    // forget tasks that were awaited already, so spawning in a loop does not pile them up
+    if (spawner.spawned.size() >= 64) {
+        auto &spawned = spawner.spawned;
+        spawned.erase(std::remove_if(spawned.begin(), spawned.end(), [](auto &task) { return task->awaited; }), spawned.end());
+    }
+    spawner.spawned.push_back(task);
+
+    // the task can't name any other global, those are left as they are
+    for (auto &entry : reached) {
+        std::swap(entry.global->value, entry.value);
+        std::swap(entry.global->defined, entry.defined);
+    }
+
+    {
+        Context running{ &task->output, true };
+        context = &running;
+
+        try {
+            task->result = invoke(function, args, line);
+            finishTasks(running);
+        } catch (RuntimeError &e) {
+            task->error = e;
+        }
+
+        context = &spawner;
+    }
+
+    for (auto &entry : reached) {
+        entry.global->value = std::move(entry.value);
+        entry.global->defined = entry.defined;
+    }
+
+    return task;
+}
+
+/* The program */
+
+// runs the translated top level code the way Interpreter::interpret does, returns the exit code
+inline int run(void (*script)(), size_t depth) {
+    maxCallDepth = depth;
+
+    Context main{ &std::cout, false };
+    context = &main;
+
+    try {
+        script();
+    } catch (RuntimeError &e) {
+        Errors::runtimeError(e);
+    }
+
+    while (true) {
+        try {
+            finishTasks(main);
+            break;
+        } catch (RuntimeError &e) {
+            // the rest still get their output flushed and errors reported
+            Errors::runtimeError(e);
+        }
+    }
+
+    return Errors::hadRuntimeError ? 70 : 0;
+}
+
+}
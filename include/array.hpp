@@ -0,0 +1,215 @@
+#pragma once
+
+#include <any>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "native.hpp"
+#include "number.hpp"
+#include "object.hpp"
+#include "runtime_error.hpp"
+#include "simd.hpp"
+#include "stats.hpp"
+
+/*
+  Arrays keep their elements as plain doubles for as long as every element
+  is a number, which is what the bulk builtins below run their SIMD kernels
+  over. Storing anything else unpacks the array into std::any elements, and
+  a bulk builtin packs it again when it finds only numbers in it.
+*/
+class LoxArray : public Object {
+public:
+    bool packed = true;
+    std::vector<double> numbers;
+    std::vector<std::any> values;
+
+    LoxArray() = default;
+
+    LoxArray(size_t size, double fill) : numbers(size, fill) {}
+
+    size_t size() const {
+        return packed ? numbers.size() : values.size();
+    }
+
+    std::any get(size_t index) const {
+        if (packed) return numbers[index];
+        return values[index];
+    }
+
+    void set(size_t index, std::any value) {
+        if (packed) {
+            if (number::get(value, numbers[index])) return;
+            unpack();
+        }
+
+        values[index] = std::move(value);
+    }
+
+    void push(std::any value) {
+        if (packed) {
+            double number;
+            if (number::get(value, number)) {
+                numbers.push_back(number);
+                return;
+            }
+            unpack();
+        }
+
+        values.push_back(std::move(value));
+    }
+
+    void unpack() {
+        if (!packed) return;
+
+        values.reserve(numbers.size());
+        for (double number : numbers) values.emplace_back(number);
+
+        numbers.clear();
+        numbers.shrink_to_fit();
+        packed = false;
+    }
+
+    // back to unboxed storage if every element is a number again
+    bool pack() {
+        if (packed) return true;
+
+        for (auto &value : values) {
+            if (!number::is(value)) return false;
+        }
+
+        numbers.resize(values.size());
+        for (size_t i = 0; i < values.size(); i++) number::get(values[i], numbers[i]);
+
+        values.clear();
+        values.shrink_to_fit();
+        packed = true;
+        return true;
+    }
+};
+
+template <>
+struct NativeType<LoxArray*> {
+    static LoxArray* from(const std::any& arg) {
+        if (auto array = std::any_cast<Ref<LoxArray>>(&arg)) return array->get();
+        throw NativeError("Expected an array.");
+    }
+};
+
+namespace array {
+
+inline LoxArray* numeric(LoxArray *array) {
+    if (!array->pack()) throw NativeError("Expected an array of numbers.");
+    return array;
+}
+
+inline size_t sameSize(LoxArray *a, LoxArray *b) {
+    if (a->numbers.size() != b->numbers.size()) throw NativeError("Arrays must have the same length.");
+    return a->numbers.size();
+}
+
+inline Ref<LoxArray> create(double size, double fill) {
+    if (size < 0 || size != std::floor(size)) throw NativeError("Array size must be a non-negative integer.");
+    return make<LoxArray>(static_cast<size_t>(size), fill);
+}
+
+// strings have a length too
+inline double len(const std::any &value) {
+    if (auto array = std::any_cast<Ref<LoxArray>>(&value)) return static_cast<double>((*array)->size());
+    if (auto text = std::any_cast<std::string>(&value)) return static_cast<double>(text->size());
+
+    throw NativeError("Expected an array or a string.");
+}
+
+inline Ref<LoxArray> push(LoxArray *array, const std::any &value) {
+    array->push(value);
+    return Ref<LoxArray>(array);
+}
+
+inline std::any pop(LoxArray *array) {
+    if (array->size() == 0) throw NativeError("Can't pop from an empty array.");
+
+    std::any last = array->get(array->size() - 1);
+    if (array->packed) array->numbers.pop_back();
+    else array->values.pop_back();
+
+    return last;
+}
+
+inline double sum(LoxArray *array) {
+    numeric(array);
+    return simd::sum(array->numbers.data(), array->numbers.size());
+}
+
+inline double min(LoxArray *array) {
+    if (numeric(array)->numbers.empty()) throw NativeError("Expected a non-empty array.");
+    return simd::min(array->numbers.data(), array->numbers.size());
+}
+
+inline double max(LoxArray *array) {
+    if (numeric(array)->numbers.empty()) throw NativeError("Expected a non-empty array.");
+    return simd::max(array->numbers.data(), array->numbers.size());
+}
+
+inline double dot(LoxArray *a, LoxArray *b) {
+    numeric(a);
+    numeric(b);
+    return simd::dot(a->numbers.data(), b->numbers.data(), sameSize(a, b));
+}
+
+inline Ref<LoxArray> scale(LoxArray *a, double k) {
+    numeric(a);
+
+    auto result = make<LoxArray>(a->numbers.size(), 0.0);
+    simd::scale(result->numbers.data(), a->numbers.data(), k, a->numbers.size());
+    return result;
+}
+
+inline Ref<LoxArray> add(LoxArray *a, LoxArray *b) {
+    numeric(a);
+    numeric(b);
+    size_t n = sameSize(a, b);
+
+    auto result = make<LoxArray>(n, 0.0);
+    simd::add(result->numbers.data(), a->numbers.data(), b->numbers.data(), n);
+    return result;
+}
+
+inline Ref<LoxArray> mul(LoxArray *a, LoxArray *b) {
+    numeric(a);
+    numeric(b);
+    size_t n = sameSize(a, b);
+
+    auto result = make<LoxArray>(n, 0.0);
+    simd::mul(result->numbers.data(), a->numbers.data(), b->numbers.data(), n);
+    return result;
+}
+
+// sorts in place and hands the array back
+inline Ref<LoxArray> sort(LoxArray *array) {
+    numeric(array);
+    simd::sort(array->numbers.data(), array->numbers.size());
+    return Ref<LoxArray>(array);
+}
+
+// scale, vadd and vmul return a new array and leave their arguments alone
+inline const std::vector<NativeDef>& natives() {
+    static const std::vector<NativeDef> defs = {
+        native<create>("array"),
+        native<len>("len"),
+        native<push>("push"),
+        native<pop>("pop"),
+        native<sum>("sum"),
+        native<min>("amin"),
+        native<max>("amax"),
+        native<dot>("dot"),
+        native<scale>("scale"),
+        native<add>("vadd"),
+        native<mul>("vmul"),
+        native<sort>("sort"),
+    };
+
+    return defs;
+}
+
+}
@@ -11,7 +11,7 @@ public:
     }
 
     std::any visitBinaryExpr(BinaryExpr* expr) override {
-        return parenthesize(expr->Operator.lexeme,
+        return parenthesize(spelling(expr->Operator.type),
                             {expr->left, expr->right});
     }
 
@@ -26,7 +26,7 @@ public:
     }
 
     std::any visitUnaryExpr(UnaryExpr* expr) override {
-        return parenthesize(expr->Operator.lexeme, {expr->right});
+        return parenthesize(spelling(expr->Operator.type), {expr->right});
     }
 
     std::any parenthesize(std::string name, std::vector<Expr*> exprs) {
@@ -41,6 +41,8 @@ public:
                 pp += std::any_cast<bool>(result) ? "true" : "false";
             else if (result.type() == typeid(double))
                 pp += std::to_string(std::any_cast<double>(result));
+            else if (result.type() == typeid(int64_t))
+                pp += std::to_string(static_cast<double>(std::any_cast<int64_t>(result)));
             else
                 pp += std::any_cast<std::string>(result);
         }
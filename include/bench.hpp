@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "string_util.hpp"
+#include "scanner.hpp"
+#include "parallel_scanner.hpp"
+#include "errors.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "resolver.hpp"
+#include "type_checker.hpp"
+#include "fuser.hpp"
+#include "dead_code.hpp"
+#include "phase.hpp"
+
+/*
+  Benchmark harness. Every workload is run through the same pipeline as
+  HD::run, but scanning, parsing and interpreting are timed separately.
+*/
+
+struct Workload {
+    std::string name;
+    std::string source;
+
+    // trips through the loop the workload is made of, 0 when it isn't one
+    size_t iterations = 0;
+};
+
+// swallows everything the interpreter prints while it is being timed
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct Summary {
+    double min = 0, max = 0, mean = 0, median = 0, stddev = 0;
+
+    static Summary of(std::vector<double> samples) {
+        Summary s;
+        if (samples.empty()) return s;
+
+        std::sort(samples.begin(), samples.end());
+        s.min = samples.front();
+        s.max = samples.back();
+
+        size_t n = samples.size();
+        s.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+
+        for (double x : samples) s.mean += x;
+        s.mean /= n;
+
+        for (double x : samples) s.stddev += (x - s.mean) * (x - s.mean);
+        s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0;
+
+        return s;
+    }
+};
+
+struct Result {
+    std::string workload;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t statements = 0;
+    size_t iterations = 0;
+    bool failed = false;
+
+    // nanoseconds per repetition, one vector per phase
+    std::vector<double> samples[static_cast<int>(Phase::__COUNT)];
+};
+
+class Bench {
+public:
+    int warmup = 2;
+    int repetitions = 10;
+    bool json = false;
+    std::string filter;
+
+    // limits every run is held to, for measuring what enforcing them costs
+    uint64_t maxFuel = 0;
+    size_t maxHeap = 0;
+
+    // scan with the ParallelScanner when above 1
+    size_t scanThreads = 1;
+
+    std::vector<Workload> workloads;
+
+    void addFile(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        workloads.push_back({ path.stem().string(), slurp(file) });
+    }
+
+    // all *.lox files of a corpus directory, sorted by name so runs are comparable
+    void addCorpus(const std::filesystem::path& dir) {
+        std::vector<std::filesystem::path> files;
+
+        for (auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.path().extension() == ".lox") files.push_back(entry.path());
+        }
+
+        std::sort(files.begin(), files.end());
+        for (auto& file : files) addFile(file);
+    }
+
+    // a large synthetic script, too big to keep in the repository
+    void addGenerated(size_t statements) {
+        std::ostringstream out;
+        out << "var total = 0;\n";
+
+        for (size_t i = 0; i < statements; i++) {
+            switch (i % 4) {
+                case 0: out << "var v" << i << " = " << i << " * 2 + 1;\n"; break;
+                case 1: out << "total = total + v" << i - 1 << " - (v" << i - 1 << " / 3);\n"; break;
+                case 2: out << "var s" << i << " = \"name\" + \"_" << i << "\";\n"; break;
+                case 3: out << "total = -(-total) + (1 + 2) * (3 - 4) / 5; // filler\n"; break;
+            }
+        }
+        out << "print total;\n";
+
+        workloads.push_back({ "generated_huge", out.str() });
+    }
+
+    // a library of functions of which the script calls only a few, mostly startup cost
+    void addLibrary(size_t functions) {
+        std::ostringstream out;
+
+        for (size_t i = 0; i < functions; i++) {
+            out << "fun f" << i << "(a, b) {\n"
+                << "    var x = a * " << i << " + b;\n"
+                << "    if (x > 100) { x = x - (a + b) / 2; } else { x = x + 1; }\n"
+                << "    var s = \"f" << i << "\" + str(x);\n"
+                << "    return len(s) + x;\n"
+                << "}\n";
+        }
+
+        out << "var total = 0;\n";
+        for (size_t i = 0; i < functions; i += functions / 10 + 1) {
+            out << "total = total + f" << i << "(3, 4);\n";
+        }
+        out << "print total;\n";
+
+        workloads.push_back({ "generated_library", out.str() });
+    }
+
+    // loop micro benchmarks, an empty loop, a loop counting a global and one adding up
+    void addLoops(size_t iterations) {
+        std::string n = std::to_string(iterations);
+
+        workloads.push_back({ "loop_empty", "for (var i = 0; i < " + n + "; i = i + 1) {}\n", iterations });
+        workloads.push_back({ "loop_counter", "var i = 0;\nwhile (i < " + n + ") i = i + 1;\nprint i;\n", iterations });
+        workloads.push_back({ "loop_accumulate",
+                              "var total = 0;\n"
+                              "for (var i = 0; i < " + n + "; i = i + 1) {\n"
+                              "    total = total + i * 2;\n"
+                              "}\n"
+                              "print total;\n", iterations });
+    }
+
+    std::vector<Result> run() {
+        std::vector<Result> results;
+
+        for (auto& workload : workloads) {
+            if (!filter.empty() && workload.name.find(filter) == std::string::npos) continue;
+
+            if (!json) std::cerr << "running " << workload.name << "...\n";
+            results.push_back(measure(workload));
+        }
+
+        return results;
+    }
+
+    void report(const std::vector<Result>& results, std::ostream& out) {
+        if (json) reportJson(results, out);
+        else reportTable(results, out);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static double elapsed(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::nano>(to - from).count();
+    }
+
+    Result measure(const Workload& workload) {
+        Result result;
+        result.workload = workload.name;
+        result.bytes = workload.source.size();
+        result.iterations = workload.iterations;
+
+        NullBuffer null;
+
+        for (int rep = 0; rep < warmup + repetitions; rep++) {
+            Errors::hadError = false;
+            Errors::hadRuntimeError = false;
+
+            auto t0 = Clock::now();
+
+            std::vector<Token> tokens;
+            if (scanThreads > 1) {
+                tokens = ParallelScanner::scanTokens(workload.source, scanThreads);
+            } else {
+                Scanner scanner(workload.source);
+                tokens = scanner.scanTokens();
+            }
+            size_t tokenCount = tokens.size();
+
+            auto t1 = Clock::now();
+
+            Parser parser(std::move(tokens));
+            std::vector<Stmt*> statements = parser.parse();
+            if (!Errors::hadError) Resolver().resolve(statements);
+            if (!Errors::hadError) TypeChecker().check(statements);
+            if (!Errors::hadError) {
+                DeadCodeEliminator([](const std::string& name) { return Interpreter::prelude()->count(name) > 0; })
+                    .eliminate(statements);
+            }
+            if (!Errors::hadError) Fuser().fuse(statements);
+
+            auto t2 = Clock::now();
+
+            if (Errors::hadError) {
+                result.failed = true;
+                for (auto stmt : statements) delete stmt;
+                break;
+            }
+
+            Interpreter interpreter;
+            interpreter.maxFuel = maxFuel;
+            interpreter.maxHeap = maxHeap;
+            auto t3 = Clock::now();
+
+            std::streambuf* saved = std::cout.rdbuf(&null);
+            interpreter.interpret(statements);
+            std::cout.rdbuf(saved);
+
+            auto t4 = Clock::now();
+
+            if (Errors::hadRuntimeError) result.failed = true;
+
+            result.tokens = tokenCount;
+            result.statements = statements.size();
+            for (auto stmt : statements) delete stmt;
+
+            if (rep < warmup) continue;
+
+            result.samples[static_cast<int>(Phase::Scan)].push_back(elapsed(t0, t1));
+            result.samples[static_cast<int>(Phase::Parse)].push_back(elapsed(t1, t2));
+            result.samples[static_cast<int>(Phase::Interpret)].push_back(elapsed(t3, t4));
+        }
+
+        return result;
+    }
+
+    // json string literal, workload names are file paths and may hold anything
+    static std::string quote(const std::string& text) {
+        std::string result = "\"";
+
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (c >= 32) {
+                result += c;
+            } else {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                result += escape;
+            }
+        }
+
+        return result + "\"";
+    }
+
+    void reportTable(const std::vector<Result>& results, std::ostream& out) {
+        out << std::left << std::setw(20) << "workload" << std::setw(11) << "phase"
+            << std::right << std::setw(12) << "min ms" << std::setw(12) << "median ms"
+            << std::setw(12) << "mean ms" << std::setw(12) << "stddev ms" << std::setw(12) << "MB/s"
+            << std::setw(14) << "M iter/s" << "\n";
+
+        out << std::fixed << std::setprecision(3);
+
+        for (auto& result : results) {
+            if (result.failed) {
+                out << std::left << std::setw(20) << result.workload << "FAILED\n";
+                continue;
+            }
+
+            for (int phase = 0; phase < static_cast<int>(Phase::__COUNT); phase++) {
+                Summary s = Summary::of(result.samples[phase]);
+                double throughput = s.median > 0 ? result.bytes / (s.median / 1e9) / 1e6 : 0;
+
+                out << std::left << std::setw(20) << result.workload
+                    << std::setw(11) << phaseName(static_cast<Phase>(phase)) << std::right
+                    << std::setw(12) << s.min / 1e6 << std::setw(12) << s.median / 1e6
+                    << std::setw(12) << s.mean / 1e6 << std::setw(12) << s.stddev / 1e6
+                    << std::setw(12) << throughput;
+
+                // only the interpreter runs the loop
+                if (result.iterations && phase == static_cast<int>(Phase::Interpret) && s.median > 0) {
+                    out << std::setw(14) << result.iterations / (s.median / 1e9) / 1e6;
+                }
+                out << "\n";
+            }
+        }
+    }
+
+    void reportJson(const std::vector<Result>& results, std::ostream& out) {
+        out << "{\n";
+        out << "  \"compiler\": " << quote(__VERSION__) << ",\n";
+#ifdef NDEBUG
+        out << "  \"optimized\": true,\n";
+#else
+        out << "  \"optimized\": false,\n";
+#endif
+        out << "  \"warmup\": " << warmup << ",\n";
+        out << "  \"repetitions\": " << repetitions << ",\n";
+        out << "  \"scan_threads\": " << scanThreads << ",\n";
+        out << "  \"results\": [";
+
+        bool first = true;
+        for (auto& result : results) {
+            out << (first ? "\n" : ",\n");
+            first = false;
+
+            out << "    {\"workload\": " << quote(result.workload)
+                << ", \"bytes\": " << result.bytes
+                << ", \"tokens\": " << result.tokens
+                << ", \"statements\": " << result.statements
+                << ", \"iterations\": " << result.iterations
+                << ", \"failed\": " << (result.failed ? "true" : "false")
+                << ", \"phases\": {";
+
+            for (int phase = 0; phase < static_cast<int>(Phase::__COUNT); phase++) {
+                Summary s = Summary::of(result.samples[phase]);
+
+                out << (phase ? ", " : "") << "\"" << phaseName(static_cast<Phase>(phase)) << "\": {"
+                    << "\"min_ns\": " << std::llround(s.min)
+                    << ", \"median_ns\": " << std::llround(s.median)
+                    << ", \"mean_ns\": " << std::llround(s.mean)
+                    << ", \"max_ns\": " << std::llround(s.max)
+                    << ", \"stddev_ns\": " << std::llround(s.stddev) << "}";
+            }
+
+            out << "}}";
+        }
+
+        out << "\n  ]\n}\n";
+    }
+};
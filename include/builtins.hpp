@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "native.hpp"
+#include "number.hpp"
+
+/*
+  The standard natives every interpreter starts with: math, strings, time
+  and a little I/O. They are plain C++ functions, native<>() works out their
+  arity and argument checks from the signature, and the number to number
+  ones are called by the interpreter without boxing their arguments.
+*/
+namespace builtins {
+
+/* Math */
+
+inline double sqrt(double x) { return std::sqrt(x); }
+inline double abs(double x) { return std::fabs(x); }
+inline double floor(double x) { return std::floor(x); }
+inline double ceil(double x) { return std::ceil(x); }
+inline double round(double x) { return std::round(x); }
+inline double trunc(double x) { return std::trunc(x); }
+inline double sin(double x) { return std::sin(x); }
+inline double cos(double x) { return std::cos(x); }
+inline double tan(double x) { return std::tan(x); }
+inline double atan(double x) { return std::atan(x); }
+inline double exp(double x) { return std::exp(x); }
+inline double log(double x) { return std::log(x); }
+
+inline double atan2(double y, double x) { return std::atan2(y, x); }
+inline double pow(double x, double y) { return std::pow(x, y); }
+inline double min(double a, double b) { return std::min(a, b); }
+inline double max(double a, double b) { return std::max(a, b); }
+inline double mod(double a, double b) { return std::fmod(a, b); }
+
+/* Strings */
+
+inline std::string upper(const std::string &text) {
+    std::string result = text;
+    for (auto &c : result) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return result;
+}
+
+inline std::string lower(const std::string &text) {
+    std::string result = text;
+    for (auto &c : result) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return result;
+}
+
+inline std::string substr(const std::string &text, double start, double length) {
+    if (start < 0 || start != std::floor(start) || start > text.size()) throw NativeError("Substring start out of range.");
+    if (length < 0 || length != std::floor(length)) throw NativeError("Substring length must be a non-negative integer.");
+
+    return text.substr(static_cast<size_t>(start), static_cast<size_t>(length));
+}
+
+// -1 when the needle is not there
+inline double indexOf(const std::string &text, const std::string &needle) {
+    size_t at = text.find(needle);
+    return at == std::string::npos ? -1 : static_cast<double>(at);
+}
+
+// formats numbers the way print does
+inline std::string str(const std::any &value) {
+    double number;
+    if (number::get(value, number)) return std::to_string(number);
+    if (auto text = std::any_cast<std::string>(&value)) return *text;
+    if (auto flag = std::any_cast<bool>(&value)) return *flag ? "true" : "false";
+    if (!value.has_value() || value.type() == typeid(nullptr_t)) return "nil";
+
+    throw NativeError("Expected a number, string, boolean or nil.");
+}
+
+// nil when the whole string is not a number
+inline std::any num(const std::string &text) {
+    std::istringstream in(text);
+    double value;
+
+    if (in >> value && (in >> std::ws).eof()) return value;
+    return std::any();
+}
+
+/* Time */
+
+// seconds on a monotonic clock, for timing things
+inline double clock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* I/O */
+
+// a line from stdin without its newline, nil at the end of input
+inline std::any input() {
+    std::string line;
+    if (!std::getline(std::cin, line)) return std::any();
+    return line;
+}
+
+// the whole file, nil if it can't be read
+inline std::any readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return std::any();
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+inline const std::vector<NativeDef>& natives() {
+    static const std::vector<NativeDef> defs = {
+        native<sqrt>("sqrt"),
+        native<abs>("abs"),
+        native<floor>("floor"),
+        native<ceil>("ceil"),
+        native<round>("round"),
+        native<trunc>("trunc"),
+        native<sin>("sin"),
+        native<cos>("cos"),
+        native<tan>("tan"),
+        native<atan>("atan"),
+        native<exp>("exp"),
+        native<log>("log"),
+        native<atan2>("atan2"),
+        native<pow>("pow"),
+        native<min>("min"),
+        native<max>("max"),
+        native<mod>("mod"),
+
+        native<upper>("upper"),
+        native<lower>("lower"),
+        native<substr>("substr"),
+        native<indexOf>("indexOf"),
+        native<str>("str"),
+        native<num>("num"),
+
+        native<clock>("clock"),
+
+        native<input>("input"),
+        native<readFile>("readFile"),
+    };
+
+    return defs;
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <any>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "object.hpp"
+#include "statement.hpp"
+#include "stats.hpp"
+
+/*
+  Hidden classes. Instances do not carry a map of their fields; they point
+  to a Shape that maps field names to indices into a flat slot array.
+  Instances that get the same fields added in the same order share a
+  Shape, so the property caches in GetExpr/SetExpr can key on it.
+*/
+class Shape {
+    std::unordered_map<std::string, int> slots;
+    std::unordered_map<std::string, std::unique_ptr<Shape>> transitions;
+
+public:
+    int find(const std::string& name) const {
+        auto it = slots.find(name);
+        return it == slots.end() ? -1 : it->second;
+    }
+
+    // the shape an instance moves to when it gets a new field
+    Shape* with(const std::string& name) {
+        auto &next = transitions[name];
+
+        if (!next) {
+            HD_STAT(shapesCreated);
+            next = std::make_unique<Shape>();
+            next->slots = slots;
+            next->slots.emplace(name, static_cast<int>(slots.size()));
+        }
+
+        return next.get();
+    }
+
+    size_t fieldCount() const {
+        return slots.size();
+    }
+};
+
+class LoxClass;
+
+// a method and the class whose declaration it came from, 'super' in its body
+// searches from that class's superclass. The same declaration run twice makes
+// two classes sharing the function, so the function alone can't tell
+struct Method {
+    FunStmt *function = nullptr;
+    LoxClass *owner = nullptr;
+};
+
+// classes are owned by the interpreter and live as long as it does, so they
+// are passed around as plain pointers and their shapes never go away
+class LoxClass {
+public:
+    std::string name;
+    LoxClass *superclass;
+
+    // own and inherited methods, flattened when the class is created
+    std::unordered_map<std::string, Method> methods;
+    Method initializer;
+
+    Shape root;
+
+    // the most fields an instance of this class has had, to size new ones
+    size_t expectedFields = 0;
+
+    LoxClass(const std::string& name, LoxClass *superclass) : name(name), superclass(superclass) {
+        if (superclass) methods = superclass->methods;
+    }
+
+    Method findMethod(const std::string& method) const {
+        auto it = methods.find(method);
+        return it == methods.end() ? Method() : it->second;
+    }
+};
+
+class LoxInstance : public Object {
+public:
+    LoxClass *klass;
+    Shape *shape;
+    std::vector<std::any> fields;
+
+    LoxInstance(LoxClass *klass) : klass(klass), shape(&klass->root) {
+        fields.reserve(klass->expectedFields);
+    }
+
+    void addField(Shape *next, std::any value) {
+        shape = next;
+        fields.push_back(std::move(value));
+        if (fields.size() > klass->expectedFields) klass->expectedFields = fields.size();
+    }
+};
+
+// a method read off an instance without calling it right away
+class LoxBoundMethod : public Object {
+public:
+    Ref<LoxInstance> receiver;
+    Method method;
+
+    LoxBoundMethod(Ref<LoxInstance> receiver, Method method) : receiver(receiver), method(method) {}
+};
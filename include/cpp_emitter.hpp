@@ -0,0 +1,780 @@
+#pragma once
+
+#include <any>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "aot_runtime.hpp"
+
+/*
+  Translates a resolved program into a single C++ translation unit for
+  hd --emit-cpp. Every function and method becomes a C++ function whose
+  locals are C++ variables named after their frame slots, globals become
+  aot::Global objects, and every operation is a call into aot_runtime.hpp,
+  which raises the interpreter's errors at the same lines.
+
+  Lox evaluates operands left to right while C++ leaves the order of
+  function arguments open, so an operand is only written inline when
+  nothing that follows it can throw or have an effect. Otherwise it is
+  computed into a temporary first. The temporaries of a statement live in
+  a block of their own.
+*/
+class CppEmitter : public ExprVisitor, public StmtVisitor {
+
+    // an expression's value in the C++ being written
+    struct Operand {
+        std::string code;
+        // a constant, a temporary or a local: reading it has no effect and can't throw
+        bool stable = false;
+        // the name of a local, which an assignment later in the expression could change
+        bool local = false;
+        // evaluating the code assigns to a local
+        bool writes = false;
+        // the code is a C++ bool rather than a std::any
+        bool boolean = false;
+        // a temporary nothing else reads, it can be moved from
+        bool temporary = false;
+    };
+
+    // bytes of code after which the top level goes on in a new function
+    static constexpr size_t PART_SIZE = 16 * 1024;
+
+    size_t maxCallDepth;
+
+    // namespace scope declarations, in the order they were needed
+    std::vector<std::string> constants, globals, classes, prototypes;
+    std::unordered_map<std::string, std::string> constantNames, keyNames;
+    std::unordered_set<std::string> globalNames;
+    std::unordered_map<std::string, int> properties;
+    std::unordered_map<const ClassStmt*, std::string> classNames;
+    std::string definitions;
+    int functions = 0;
+
+    // the C++ function being written
+    std::string *out = nullptr;
+    int indent = 0;
+    int temps = 0;
+    FunStmt *function = nullptr;
+    bool usesTail = false;
+
+    Operand emit(Expr *expr) {
+        return std::any_cast<Operand>(expr->accept(this));
+    }
+
+    void emit(Stmt *stmt) {
+        stmt->accept(this);
+    }
+
+    void line(const std::string& text) {
+        out->append(4 * indent, ' ');
+        *out += text;
+        *out += '\n';
+    }
+
+    std::string temp(const char *prefix = "t") {
+        return prefix + std::to_string(temps++);
+    }
+
+    static std::string number(int value) {
+        return std::to_string(value);
+    }
+
+    static std::string quote(const std::string& text) {
+        std::string result = "\"";
+
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (c >= 32 && c < 127) {
+                result += c;
+            } else {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\%03o", c);
+                result += escape;
+            }
+        }
+
+        return result + "\"";
+    }
+
+    static std::string local(int slot, const std::string& name) {
+        return "v" + number(slot) + "_" + name;
+    }
+
+    std::string global(const std::string& name) {
+        std::string variable = "g_" + name;
+
+        if (globalNames.insert(name).second) {
+            // the builtins are globals the script starts with
+            bool builtin = aot::native(name).has_value();
+            globals.push_back("aot::Global " + variable + "{ " + quote(name) +
+                              (builtin ? ", aot::native(" + quote(name) + ")" : "") + " };");
+        }
+
+        return variable;
+    }
+
+    int property(const std::string& name) {
+        return properties.emplace(name, static_cast<int>(properties.size())).first->second;
+    }
+
+    std::string constant(const std::any& value) {
+        std::string init;
+
+        if (!value.has_value()) init = "std::any()";
+        else if (value.type() == typeid(nullptr_t)) init = "nullptr";
+        else if (auto flag = std::any_cast<bool>(&value)) init = *flag ? "true" : "false";
+        else if (auto integer = std::any_cast<int64_t>(&value)) init = "int64_t(" + std::to_string(*integer) + ")";
+        else if (auto text = std::any_cast<std::string>(&value)) init = "std::string(" + quote(*text) + ", " + std::to_string(text->size()) + ")";
+        else {
+            double real = std::any_cast<double>(value);
+            if (std::isinf(real)) {
+                init = "HUGE_VAL";
+            } else {
+                // hex floats are exact
+                char buffer[64];
+                std::snprintf(buffer, sizeof(buffer), "%a", real);
+                init = buffer;
+            }
+        }
+
+        auto &name = constantNames[init];
+        if (name.empty()) {
+            name = "K" + number(static_cast<int>(constantNames.size() - 1));
+            constants.push_back("const std::any " + name + " = " + init + ";");
+        }
+
+        return name;
+    }
+
+    // an interned map key for a string literal index, see IndexExpr::key
+    std::string key(const std::string& text) {
+        auto &name = keyNames[text];
+        if (name.empty()) {
+            name = "M" + number(static_cast<int>(keyNames.size() - 1));
+            constants.push_back("const MapKey " + name + " = MapKey::of(Symbols::intern(std::string(" +
+                                quote(text) + ", " + std::to_string(text.size()) + ")));");
+        }
+
+        return name;
+    }
+
+    std::string className(const ClassStmt *stmt) {
+        auto &name = classNames[stmt];
+        if (name.empty()) {
+            name = "c" + number(static_cast<int>(classNames.size() - 1)) + "_" + stmt->name.lexeme;
+            classes.push_back("aot::Class *" + name + " = nullptr;");
+        }
+
+        return name;
+    }
+
+    /* Operands */
+
+    // nothing evaluating expr can do is observable: it only reads constants
+    static bool isConstant(Expr *expr) {
+        if (auto group = dynamic_cast<GroupingExpr*>(expr)) return isConstant(group->expression);
+        return dynamic_cast<LiteralExpr*>(expr) || dynamic_cast<ThisExpr*>(expr);
+    }
+
+    // evaluating expr can't throw or change anything, but it may read locals
+    static bool isPure(Expr *expr) {
+        if (auto group = dynamic_cast<GroupingExpr*>(expr)) return isPure(group->expression);
+        if (auto variable = dynamic_cast<VariableExpr*>(expr)) return variable->slot >= 0;
+        return isConstant(expr);
+    }
+
+    Operand result(std::string code, bool writes = false, bool boolean = false) {
+        Operand operand;
+        operand.code = std::move(code);
+        operand.writes = writes;
+        operand.boolean = boolean;
+        return operand;
+    }
+
+    // computes the operand now, into a temporary
+    Operand hoist(const Operand& operand) {
+        if (operand.stable && !operand.local) return operand;
+
+        Operand value;
+        value.code = temp();
+        value.stable = value.temporary = true;
+        value.boolean = operand.boolean;
+        line(std::string(operand.boolean ? "bool " : "std::any ") + value.code + " = " + operand.code + ";");
+        return value;
+    }
+
+    // an operand about to be followed by the expressions in rest, hoisted if they
+    // could run before it or change it
+    Operand before(const Operand& operand, const std::vector<Expr*>& rest, size_t from = 0) {
+        bool reads = false;
+
+        for (size_t i = from; i < rest.size(); i++) {
+            if (!isPure(rest[i])) return operand.stable && !operand.local ? operand : hoist(operand);
+            reads = reads || !isConstant(rest[i]);
+        }
+
+        return reads && operand.writes ? hoist(operand) : operand;
+    }
+
+    Operand before(const Operand& operand, Expr *next) {
+        return before(operand, std::vector<Expr*>{ next });
+    }
+
+    static std::string value(const Operand& operand) {
+        return operand.boolean ? "std::any(" + operand.code + ")" : operand.code;
+    }
+
+    static std::string take(const Operand& operand) {
+        return operand.temporary && !operand.boolean ? "std::move(" + operand.code + ")" : value(operand);
+    }
+
+    static std::string test(const Operand& operand) {
+        return operand.boolean ? operand.code : "aot::isTrue(" + operand.code + ")";
+    }
+
+    // the arguments of a call in an array whose first element is left for a receiver
+    std::string arguments(const std::vector<Expr*>& arguments) {
+        std::string list = "{}";
+
+        for (size_t i = 0; i < arguments.size(); i++) {
+            Operand argument = before(emit(arguments[i]), arguments, i + 1);
+            list += ", " + take(argument);
+        }
+
+        // a braced list is evaluated left to right
+        std::string array = temp("a");
+        line("std::any " + array + "[] = { " + list + " };");
+        return array;
+    }
+
+    Operand binary(Mark Operator, const Operand& left, const Operand& right) {
+        std::string at = number(Operator.line);
+        std::string operands = value(left) + ", " + value(right);
+        bool writes = left.writes || right.writes;
+
+        switch (Operator.type) {
+            case TokenType::EQUAL_EQUAL:   return result("aot::isEqual(" + operands + ")", writes, true);
+            case TokenType::BANG_EQUAL:    return result("!aot::isEqual(" + operands + ")", writes, true);
+            case TokenType::GREATER:       return result("aot::greater(" + at + ", " + operands + ")", writes, true);
+            case TokenType::GREATER_EQUAL: return result("aot::greaterEqual(" + at + ", " + operands + ")", writes, true);
+            case TokenType::LESS:          return result("aot::less(" + at + ", " + operands + ")", writes, true);
+            case TokenType::LESS_EQUAL:    return result("aot::lessEqual(" + at + ", " + operands + ")", writes, true);
+            case TokenType::MINUS:         return result("aot::subtract(" + at + ", " + operands + ")", writes);
+            case TokenType::STAR:          return result("aot::multiply(" + at + ", " + operands + ")", writes);
+            case TokenType::SLASH:         return result("aot::divide(" + at + ", " + operands + ")", writes);
+            default:                       return result("aot::add(" + at + ", " + operands + ")", writes);
+        }
+    }
+
+    // a local's name or a global's value
+    Operand variable(const Token& name, int slot) {
+        if (slot < 0) return result(global(name.lexeme) + ".get(" + number(name.line) + ")");
+
+        Operand operand;
+        operand.code = local(slot, name.lexeme);
+        operand.stable = operand.local = true;
+        return operand;
+    }
+
+    Operand assign(const Token& name, int slot, const Operand& value) {
+        if (slot >= 0) return result("(" + local(slot, name.lexeme) + " = " + take(value) + ")", true);
+        return result(global(name.lexeme) + ".assign(" + take(value) + ", " + number(name.line) + ")", value.writes);
+    }
+
+    /* Statements */
+
+    // runs build with what it hoists going to a string of its own, one level deeper
+    template <typename Build>
+    std::pair<std::string, std::string> capture(Build build) {
+        std::string *enclosing = out;
+        std::string hoisted;
+
+        out = &hoisted;
+        indent++;
+        std::string last = build();
+        indent--;
+        out = enclosing;
+
+        return { hoisted, last };
+    }
+
+    // a statement, inside a block with its temporaries if it has any
+    void place(const std::pair<std::string, std::string>& statement) {
+        auto &[hoisted, last] = statement;
+
+        if (hoisted.empty()) {
+            if (!last.empty()) line(last);
+            return;
+        }
+
+        line("{");
+        *out += hoisted;
+        indent++;
+        if (!last.empty()) line(last);
+        indent--;
+        line("}");
+    }
+
+    template <typename Build>
+    void statement(Build build) {
+        place(capture(build));
+    }
+
+    // an expression that only runs for what it does
+    std::string effect(Expr *expr) {
+        Operand operand = emit(expr);
+        if (operand.stable) return std::string();
+        return operand.boolean ? "(void) (" + operand.code + ");" : operand.code + ";";
+    }
+
+    // the body of an if, a block's statements go straight into the C++ block
+    void branch(Stmt *stmt) {
+        indent++;
+        if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
+            for (auto inner : block->statements) emit(inner);
+        } else {
+            emit(stmt);
+        }
+        indent--;
+    }
+
+    // writes out a function or a method, returns the name of its FunctionInfo
+    std::string declare(FunStmt *stmt) {
+        int index = functions++;
+        std::string code = "f" + number(index) + "_" + stmt->name.lexeme;
+        std::string info = "F" + number(index);
+
+        std::string *enclosingOut = out;
+        int enclosingIndent = indent, enclosingTemps = temps;
+        FunStmt *enclosingFunction = function;
+        bool enclosingTail = usesTail;
+
+        std::string body;
+        out = &body;
+        indent = 1;
+        temps = 0;
+        function = stmt;
+        usesTail = false;
+
+        int first = 0;
+        if (stmt->kind != FunctionKind::Function) line("std::any " + local(first++, "this") + " = std::move(frame[0]);");
+
+        for (auto &param : stmt->params) {
+            line("std::any " + local(first, param.lexeme) + " = std::move(frame[" + number(first) + "]);");
+            first++;
+        }
+
+        for (auto inner : stmt->body) emit(inner);
+        line(stmt->kind == FunctionKind::Initializer ? "return " + local(0, "this") + ";" : "return std::any();");
+
+        // what a task running it can reach, methods never run in one on their own
+        std::string reach = "nullptr, 0";
+        if (stmt->kind == FunctionKind::Function && !stmt->globals.empty()) {
+            std::string list = "R" + number(index), entries;
+            for (auto &name : stmt->globals) entries += " &" + global(name) + ",";
+
+            prototypes.push_back("aot::Global *const " + list + "[] = {" + entries + " };");
+            reach = list + ", " + std::to_string(stmt->globals.size());
+        }
+
+        std::string signature = "std::any " + code + "(std::any *" + (first ? "frame" : "") + ", aot::Tail &" +
+                                (usesTail ? "tail" : "") + ")";
+        prototypes.push_back(signature + ";");
+        prototypes.push_back("const aot::FunctionInfo " + info + "{ " + quote(stmt->name.lexeme) + ", " +
+                             std::to_string(stmt->params.size()) + ", " + code + ", " + reach + " };");
+        definitions += signature + " {\n" + body + "}\n\n";
+
+        out = enclosingOut;
+        indent = enclosingIndent;
+        temps = enclosingTemps;
+        function = enclosingFunction;
+        usesTail = enclosingTail;
+
+        return info;
+    }
+
+    // defines a variable declared by a statement in the enclosing frame or the globals
+    void define(const Token& name, int slot, const std::string& value) {
+        if (slot >= 0) line("std::any " + local(slot, name.lexeme) + " = " + value + ";");
+        else line(global(name.lexeme) + ".define(" + value + ");");
+    }
+
+public:
+    explicit CppEmitter(size_t maxCallDepth = 1000) : maxCallDepth(maxCallDepth) {}
+
+    // source is only named in the header comment
+    void emit(const std::vector<Stmt*>& statements, const std::string& source, std::ostream& output) {
+        // the top level is cut into parts, compilers slow down badly on one huge function
+        std::vector<std::string> parts{ "" };
+        indent = 1;
+
+        for (auto stmt : statements) {
+            if (parts.back().size() > PART_SIZE) parts.emplace_back();
+            out = &parts.back();
+            emit(stmt);
+        }
+
+        output << "// generated by hd --emit-cpp from " << source << ", build it with\n"
+               << "//   c++ -std=c++17 -O2 -DNDEBUG -I<hd>/include -I<generated headers> -pthread <this file>\n"
+               << "\n#include \"aot_runtime.hpp\"\n\nnamespace {\n\n";
+
+        auto section = [&](const char *comment, const std::vector<std::string>& lines) {
+            if (lines.empty()) return;
+            output << "// " << comment << "\n";
+            for (auto &text : lines) output << text << "\n";
+            output << "\n";
+        };
+
+        section("literals", constants);
+        section("globals", globals);
+        section("the class each declaration created last", classes);
+        section("functions and methods", prototypes);
+
+        output << definitions;
+        for (size_t i = 0; i < parts.size(); i++) {
+            output << "[[gnu::noinline]] void part" << i << "() {\n" << parts[i] << "}\n\n";
+        }
+
+        output << "void script() {\n";
+        for (size_t i = 0; i < parts.size(); i++) output << "    part" << i << "();\n";
+        output << "}\n\n}\n\n"
+               << "int main() {\n"
+               << "    return aot::run(script, " << maxCallDepth << ");\n"
+               << "}\n";
+    }
+
+    /* Expressions */
+
+    std::any visitLiteralExpr(LiteralExpr *expr) override {
+        Operand operand;
+        operand.code = constant(expr->value);
+        operand.stable = true;
+        return operand;
+    }
+
+    std::any visitGroupingExpr(GroupingExpr *expr) override {
+        return emit(expr->expression);
+    }
+
+    std::any visitUnaryExpr(UnaryExpr *expr) override {
+        Operand right = emit(expr->right);
+
+        if (expr->Operator.type == TokenType::BANG) {
+            return result(right.boolean ? "!(" + right.code + ")" : "!aot::isTrue(" + right.code + ")", right.writes, true);
+        }
+
+        return result("aot::negate(" + number(expr->Operator.line) + ", " + value(right) + ")", right.writes);
+    }
+
+    std::any visitBinaryExpr(BinaryExpr *expr) override {
+        Operand left = before(emit(expr->left), expr->right);
+        Operand right = emit(expr->right);
+        return binary(expr->Operator, left, right);
+    }
+
+    std::any visitVariableExpr(VariableExpr *expr) override {
+        return variable(expr->name, expr->slot);
+    }
+
+    std::any visitAssignExpr(AssignExpr *expr) override {
+        return assign(expr->name, expr->slot, emit(expr->value));
+    }
+
+    std::any visitCallExpr(CallExpr *expr) override {
+        std::string paren = number(expr->paren.line);
+        std::string count = std::to_string(expr->arguments.size());
+
+        // the property is looked up before the arguments are evaluated
+        if (GetExpr *get = expr->property) {
+            Operand object = emit(get->object);
+            std::string found = temp("p");
+            line("aot::Property " + found + " = aot::property(" + number(get->name.line) + ", " + value(object) + ", " +
+                 number(property(get->name.lexeme)) + ", " + quote(get->name.lexeme) + ");");
+
+            std::string args = arguments(expr->arguments);
+            return result("aot::callProperty(" + paren + ", " + found + ", " + args + ", " + count + ")");
+        }
+
+        if (SuperExpr *super = expr->superMethod) {
+            std::string method = temp("m");
+            line("aot::Method " + method + " = aot::superMethod(" + number(property(super->method.lexeme)) + ", " +
+                 quote(super->method.lexeme) + ", " + number(super->method.line) + ");");
+
+            std::string args = arguments(expr->arguments);
+            return result("aot::invokeSuper(" + paren + ", " + local(super->slot, "this") + ", " + method + ", " +
+                          args + ", " + count + ")");
+        }
+
+        Operand callee = before(emit(expr->callee), expr->arguments);
+        std::string args = arguments(expr->arguments);
+        return result("aot::call(" + paren + ", " + value(callee) + ", " + args + ", " + count + ")");
+    }
+
+    std::any visitGetExpr(GetExpr *expr) override {
+        Operand object = emit(expr->object);
+        return result("aot::get(" + number(expr->name.line) + ", " + value(object) + ", " +
+                      number(property(expr->name.lexeme)) + ", " + quote(expr->name.lexeme) + ")", object.writes);
+    }
+
+    std::any visitSetExpr(SetExpr *expr) override {
+        // the object must be an instance before the value is evaluated
+        Operand object = emit(expr->object);
+        std::string instance = temp("i");
+        line("Ref<aot::Instance> " + instance + " = aot::fields(" + number(expr->name.line) + ", " + value(object) + ");");
+
+        Operand assigned = emit(expr->value);
+        return result("aot::set(" + instance + ", " + number(property(expr->name.lexeme)) + ", " + take(assigned) + ")",
+                      assigned.writes);
+    }
+
+    std::any visitThisExpr(ThisExpr *expr) override {
+        Operand operand;
+        operand.code = local(expr->slot, "this");
+        operand.stable = true;
+        return operand;
+    }
+
+    std::any visitSuperExpr(SuperExpr *expr) override {
+        return result("aot::bind(" + local(expr->slot, "this") + ", aot::superMethod(" + number(property(expr->method.lexeme)) +
+                      ", " + quote(expr->method.lexeme) + ", " + number(expr->method.line) + "))");
+    }
+
+    std::any visitArrayExpr(ArrayExpr *expr) override {
+        if (expr->elements.empty()) return result("aot::array(0)");
+
+        Operand array;
+        array.code = temp();
+        array.stable = array.temporary = true;
+        line("Ref<LoxArray> " + array.code + " = aot::array(" + std::to_string(expr->elements.size()) + ");");
+
+        for (auto element : expr->elements) line(array.code + "->push(" + take(emit(element)) + ");");
+        return array;
+    }
+
+    std::any visitIndexExpr(IndexExpr *expr) override {
+        std::string at = number(expr->bracket.line);
+
+        // only arrays and maps get as far as evaluating the index
+        Operand object = before(emit(expr->object), expr->index);
+        if (!isPure(expr->index)) line("aot::indexable(" + at + ", " + value(object) + ");");
+
+        Operand index = emit(expr->index);
+        std::string literal = expr->key ? ", &" + key(expr->key->text) : "";
+        return result("aot::index(" + at + ", " + value(object) + ", " + value(index) + literal + ")",
+                      object.writes || index.writes);
+    }
+
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override {
+        std::string at = number(expr->bracket.line);
+
+        Operand object = before(emit(expr->object), expr->index);
+        if (!isPure(expr->index)) line("aot::indexable(" + at + ", " + value(object) + ");");
+
+        Operand index = emit(expr->index);
+        std::string literal = expr->key ? ", &" + key(expr->key->text) : "";
+        std::string target = temp("g");
+        line("aot::Target " + target + " = aot::target(" + at + ", " + value(object) + ", " + value(index) + literal + ");");
+
+        Operand assigned = emit(expr->value);
+        return result("aot::store(" + at + ", " + target + ", " + take(assigned) + ")", assigned.writes);
+    }
+
+    std::any visitSpawnExpr(SpawnExpr *expr) override {
+        std::string at = number(expr->keyword.line);
+        CallExpr *call = expr->call;
+
+        Operand callee = emit(call->callee);
+        std::string function = temp("s"), copies = temp("c");
+        line("const aot::FunctionInfo *" + function + " = aot::spawnable(" + at + ", " + value(callee) + ");");
+        line("aot::Copies " + copies + ";");
+
+        std::string args = "nullptr";
+        if (!call->arguments.empty()) {
+            args = temp("a");
+            line("std::any " + args + "[" + std::to_string(call->arguments.size()) + "];");
+
+            // each argument is copied as soon as it is evaluated
+            for (size_t i = 0; i < call->arguments.size(); i++) {
+                line(args + "[" + std::to_string(i) + "] = aot::sendArgument(" + at + ", " +
+                     value(emit(call->arguments[i])) + ", " + copies + ");");
+            }
+        }
+
+        return result("aot::spawn(" + number(call->paren.line) + ", " + function + ", " + args + ", " +
+                      std::to_string(call->arguments.size()) + ", " + copies + ")");
+    }
+
+    std::any visitAwaitExpr(AwaitExpr *expr) override {
+        Operand task = emit(expr->task);
+        return result("aot::await(" + number(expr->keyword.line) + ", " + value(task) + ")", task.writes);
+    }
+
+    // the fused nodes are only made by the Fuser, which hd --emit-cpp does not run;
+    // these spell them out as the nodes they replaced
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override {
+        Operand constant;
+        constant.code = this->constant(expr->constant);
+        constant.stable = true;
+
+        return assign(expr->name, expr->slot, binary(expr->Operator, variable(expr->name, expr->slot), constant));
+    }
+
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override {
+        Operand constant;
+        constant.code = this->constant(expr->constant);
+        constant.stable = true;
+
+        Operand variable = this->variable(expr->name, expr->slot);
+        if (expr->literalFirst) return binary(expr->Operator, constant, variable);
+        return binary(expr->Operator, variable, constant);
+    }
+
+    std::any visitVarVarExpr(VarVarExpr *expr) override {
+        Operand left = variable(expr->left, expr->leftSlot);
+        if (expr->rightSlot < 0) left = hoist(left);
+
+        return binary(expr->Operator, left, variable(expr->right, expr->rightSlot));
+    }
+
+    /* Statements */
+
+    void visitExpressionStmt(ExpressionStmt *stmt) override {
+        statement([&] { return effect(stmt->expression); });
+    }
+
+    void visitPrintStmt(PrintStmt *stmt) override {
+        statement([&] { return "aot::print(" + value(emit(stmt->expression)) + ");"; });
+    }
+
+    void visitVarStmt(VarStmt *stmt) override {
+        auto [hoisted, initializer] = capture([&] {
+            return stmt->initializer ? take(emit(stmt->initializer)) : std::string("std::any()");
+        });
+
+        if (stmt->slot < 0) {
+            place({ hoisted, global(stmt->name.lexeme) + ".define(" + initializer + ");" });
+            return;
+        }
+
+        // the local outlives the block holding the temporaries
+        std::string name = local(stmt->slot, stmt->name.lexeme);
+        if (hoisted.empty()) {
+            line("std::any " + name + " = " + initializer + ";");
+        } else {
+            line("std::any " + name + ";");
+            place({ hoisted, name + " = " + initializer + ";" });
+        }
+    }
+
+    void visitBlockStmt(BlockStmt *stmt) override {
+        line("{");
+        indent++;
+        for (auto inner : stmt->statements) emit(inner);
+        indent--;
+        line("}");
+    }
+
+    void visitFunStmt(FunStmt *stmt) override {
+        define(stmt->name, stmt->slot, "aot::Function{ &" + declare(stmt) + " }");
+    }
+
+    void visitReturnStmt(ReturnStmt *stmt) override {
+        if (function->kind == FunctionKind::Initializer) {
+            line("return " + local(0, "this") + ";");
+            return;
+        }
+
+        if (!stmt->value) {
+            line("return std::any();");
+            return;
+        }
+
+        statement([&] {
+            if (!stmt->tailCall) return "return " + take(emit(stmt->value)) + ";";
+
+            // a function called in tail position runs in this frame, see aot::invoke
+            auto call = static_cast<CallExpr*>(stmt->value);
+            usesTail = true;
+
+            Operand callee = before(emit(call->callee), call->arguments);
+            std::string args = arguments(call->arguments);
+            return "return aot::tailCall(tail, " + number(call->paren.line) + ", " + value(callee) + ", " + args + ", " +
+                   std::to_string(call->arguments.size()) + ");";
+        });
+    }
+
+    void visitIfStmt(IfStmt *stmt) override {
+        auto [hoisted, condition] = capture([&] { return test(emit(stmt->condition)); });
+
+        if (!hoisted.empty()) {
+            line("{");
+            *out += hoisted;
+            indent++;
+        }
+
+        line("if (" + condition + ") {");
+        branch(stmt->thenBranch);
+        if (stmt->elseBranch) {
+            line("} else {");
+            branch(stmt->elseBranch);
+        }
+        line("}");
+
+        if (!hoisted.empty()) {
+            indent--;
+            line("}");
+        }
+    }
+
+    // the condition is tested at the top of the C++ loop, after its temporaries
+    void visitWhileStmt(WhileStmt *stmt) override {
+        line("while (true) {");
+        indent++;
+        statement([&] { return "if (!(" + test(emit(stmt->condition)) + ")) break;"; });
+        indent--;
+
+        branch(stmt->body);
+
+        if (stmt->increment) {
+            indent++;
+            statement([&] { return effect(stmt->increment); });
+            indent--;
+        }
+        line("}");
+    }
+
+    void visitClassStmt(ClassStmt *stmt) override {
+        std::string klass = className(stmt);
+
+        std::string methods;
+        for (auto method : stmt->methods) {
+            std::string info = declare(method);
+            methods += std::string(methods.empty() ? "" : ", ") + "{ " + number(property(method->name.lexeme)) + ", &" + info + " }";
+        }
+
+        statement([&] {
+            line("aot::checkClass(" + number(stmt->name.line) + ");");
+
+            std::string superclass = "nullptr";
+            if (stmt->superclass) {
+                Operand parent = emit(stmt->superclass);
+                superclass = "aot::superclass(" + number(stmt->superclass->name.line) + ", " + value(parent) + ")";
+            }
+
+            return klass + " = aot::declareClass(" + quote(stmt->name.lexeme) + ", " + superclass + ", { " + methods +
+                   " }, " + number(property("init")) + ");";
+        });
+
+        define(stmt->name, stmt->slot, klass);
+    }
+};
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "stats.hpp"
+
+/*
+  Whole program pass that drops what can't make a difference to a run:
+
+    var unused = 1 + 2;         a global nothing mentions, and its definition
+    fun helper() { ... }        the same for functions and classes
+    x;  "text";  [a, b];        expression statements without an effect
+
+  A statement is only removed when running it can't print, assign, call
+  anything or raise a RuntimeError. A global nothing mentions whose
+  initializer does have an effect keeps the initializer as an expression
+  statement. Every mention of a name counts, reads and assignments alike, so
+  no assignment is left to a global that is gone; the bodies of functions
+  the Parser only skimmed are searched by their tokens. Runs after the
+  Resolver and the TypeChecker, whose proven operand types tell which
+  operators can't fail, and only on whole programs: at the prompt a later
+  line may still mention anything.
+*/
+class DeadCodeEliminator : public ExprVisitor, public StmtVisitor {
+
+    // globals defined before the script starts, such as the natives
+    std::function<bool(const std::string&)> predefined;
+
+    // how often each global name is mentioned in what is left of the program
+    std::unordered_map<std::string, int> mentions;
+
+    // +1 while counting, -1 while taking out what a removed statement mentioned,
+    // 0 while only asking whether an expression is inert
+    int weight = 1;
+
+    // index of the top level statement being swept, globals defined by top
+    // level statements before it can be read without an error
+    size_t position = 0;
+    std::unordered_map<std::string, size_t> definitions;
+    bool inFunction = false;
+
+    void mention(const std::string& name) {
+        if (weight) mentions[name] += weight;
+    }
+
+    // whether the expression is inert, counting its mentions by weight on the way
+    bool visit(Expr *expr) {
+        return !expr || std::any_cast<bool>(expr->accept(this));
+    }
+
+    void visit(Stmt *stmt) {
+        if (stmt) stmt->accept(this);
+    }
+
+    void visit(const std::vector<Stmt*>& statements) {
+        for (auto stmt : statements) visit(stmt);
+    }
+
+    void count(Stmt *stmt, int by) {
+        int enclosing = weight;
+        weight = by;
+        visit(stmt);
+        weight = enclosing;
+    }
+
+    // no output, no assignment, no call and no RuntimeError
+    bool inert(Expr *expr) {
+        int enclosing = weight;
+        weight = 0;
+        bool result = visit(expr);
+        weight = enclosing;
+        return result;
+    }
+
+    // reading the global can't fail with "Undefined variable"
+    bool defined(const std::string& name) const {
+        if (predefined(name)) return true;
+        if (inFunction) return false;
+
+        auto it = definitions.find(name);
+        return it != definitions.end() && it->second < position;
+    }
+
+    // the operator can't raise a type error
+    static bool safe(TokenType Operator, Operands operands) {
+        return Operator == TokenType::EQUAL_EQUAL || Operator == TokenType::BANG_EQUAL || operands != Operands::Unknown;
+    }
+
+    bool unused(const Token& name) {
+        auto it = mentions.find(name.lexeme);
+        return it == mentions.end() || it->second <= 0;
+    }
+
+    static const Token* defines(Stmt *stmt) {
+        auto &type = typeid(*stmt);
+
+        if (type == typeid(VarStmt)) return &static_cast<VarStmt*>(stmt)->name;
+        if (type == typeid(FunStmt)) return &static_cast<FunStmt*>(stmt)->name;
+        if (type == typeid(ClassStmt)) return &static_cast<ClassStmt*>(stmt)->name;
+        return nullptr;
+    }
+
+    // what the statement becomes, itself, another statement or null when it goes
+    Stmt* prune(Stmt *stmt, bool global) {
+        auto &type = typeid(*stmt);
+
+        if (type == typeid(ExpressionStmt)) {
+            return inert(static_cast<ExpressionStmt*>(stmt)->expression) ? nullptr : stmt;
+        }
+
+        if (type == typeid(BlockStmt)) {
+            auto block = static_cast<BlockStmt*>(stmt);
+            sweep(block->statements, false);
+            return block->statements.empty() ? nullptr : stmt;
+        }
+
+        if (type == typeid(IfStmt)) {
+            auto branch = static_cast<IfStmt*>(stmt);
+            for (Stmt *nested : { branch->thenBranch, branch->elseBranch }) {
+                if (nested && typeid(*nested) == typeid(BlockStmt)) sweep(static_cast<BlockStmt*>(nested)->statements, false);
+            }
+            return stmt;
+        }
+
+        // a loop stays even when its body turns out empty, it may never end
+        if (type == typeid(WhileStmt)) {
+            auto loop = static_cast<WhileStmt*>(stmt);
+            if (typeid(*loop->body) == typeid(BlockStmt)) sweep(static_cast<BlockStmt*>(loop->body)->statements, false);
+            return stmt;
+        }
+
+        if (type == typeid(FunStmt)) {
+            auto function = static_cast<FunStmt*>(stmt);
+            if (global && unused(function->name)) return nullptr;
+
+            body(function);
+            return stmt;
+        }
+
+        if (type == typeid(ClassStmt)) {
+            auto klass = static_cast<ClassStmt*>(stmt);
+            // looking up a superclass can fail
+            if (global && !klass->superclass && unused(klass->name)) return nullptr;
+
+            for (auto method : klass->methods) body(method);
+            return stmt;
+        }
+
+        if (type == typeid(VarStmt)) {
+            auto var = static_cast<VarStmt*>(stmt);
+            if (!global || !unused(var->name)) return stmt;
+            if (inert(var->initializer)) return nullptr;
+
+            // the initializer still has to run
+            auto effect = new ExpressionStmt(var->initializer);
+            var->initializer = nullptr;
+            delete var;
+            return effect;
+        }
+
+        return stmt;
+    }
+
+    void body(FunStmt *function) {
+        bool enclosing = inFunction;
+        inFunction = true;
+        sweep(function->body, false);
+        inFunction = enclosing;
+    }
+
+    // removes what is dead from the list, last to first, so that a definition
+    // is looked at once everything after it that mentions it is gone
+    bool sweep(std::vector<Stmt*>& statements, bool top) {
+        std::vector<Stmt*> kept;
+        kept.reserve(statements.size());
+        bool removed = false;
+
+        if (top) {
+            definitions.clear();
+            for (size_t i = 0; i < statements.size(); i++) {
+                if (auto name = defines(statements[i])) definitions.try_emplace(name->lexeme, i);
+            }
+        }
+
+        for (size_t i = statements.size(); i-- > 0; ) {
+            if (top) position = i;
+            Stmt *stmt = statements[i];
+
+            // block locals live in frame slots, only globals are taken out
+            bool global = top && !inFunction;
+            Stmt *result = prune(stmt, global);
+
+            if (result == stmt) {
+                kept.push_back(stmt);
+                continue;
+            }
+
+            HD_STAT(deadStatements);
+            removed = true;
+
+            if (result) {
+                kept.push_back(result);
+            } else {
+                count(stmt, -1);
+                delete stmt;
+            }
+        }
+
+        std::reverse(kept.begin(), kept.end());
+        statements = std::move(kept);
+        return removed;
+    }
+
+public:
+    explicit DeadCodeEliminator(std::function<bool(const std::string&)> predefined)
+    : predefined(std::move(predefined)) {}
+
+    void eliminate(std::vector<Stmt*>& statements) {
+        visit(statements);
+
+        // a removal can leave an earlier definition unmentioned
+        while (sweep(statements, true)) {}
+    }
+
+    /* Expressions */
+
+    std::any visitBinaryExpr(BinaryExpr *expr) override {
+        bool left = visit(expr->left);
+        bool right = visit(expr->right);
+        return left && right && safe(expr->Operator.type, expr->operands);
+    }
+
+    std::any visitGroupingExpr(GroupingExpr *expr) override {
+        return visit(expr->expression);
+    }
+
+    std::any visitLiteralExpr(LiteralExpr *) override {
+        return true;
+    }
+
+    std::any visitUnaryExpr(UnaryExpr *expr) override {
+        bool right = visit(expr->right);
+        return right && (expr->Operator.type == TokenType::BANG || expr->operands != Operands::Unknown);
+    }
+
+    std::any visitVariableExpr(VariableExpr *expr) override {
+        if (expr->slot >= 0) return true;
+
+        mention(expr->name.lexeme);
+        return defined(expr->name.lexeme);
+    }
+
+    std::any visitAssignExpr(AssignExpr *expr) override {
+        if (expr->slot < 0) mention(expr->name.lexeme);
+        visit(expr->value);
+        return false;
+    }
+
+    std::any visitCallExpr(CallExpr *expr) override {
+        visit(expr->callee);
+        for (auto arg : expr->arguments) visit(arg);
+        return false;
+    }
+
+    std::any visitGetExpr(GetExpr *expr) override {
+        visit(expr->object);
+        return false;
+    }
+
+    std::any visitSetExpr(SetExpr *expr) override {
+        visit(expr->object);
+        visit(expr->value);
+        return false;
+    }
+
+    std::any visitThisExpr(ThisExpr *) override {
+        return true;
+    }
+
+    std::any visitSuperExpr(SuperExpr *) override {
+        return false;
+    }
+
+    std::any visitArrayExpr(ArrayExpr *expr) override {
+        bool elements = true;
+        for (auto element : expr->elements) elements = visit(element) && elements;
+        return elements;
+    }
+
+    std::any visitIndexExpr(IndexExpr *expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        return false;
+    }
+
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override {
+        visit(expr->object);
+        visit(expr->index);
+        visit(expr->value);
+        return false;
+    }
+
+    std::any visitSpawnExpr(SpawnExpr *expr) override {
+        visit(expr->call);
+        return false;
+    }
+
+    std::any visitAwaitExpr(AwaitExpr *expr) override {
+        visit(expr->task);
+        return false;
+    }
+
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override {
+        if (expr->slot < 0) mention(expr->name.lexeme);
+        return false;
+    }
+
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override {
+        bool variable = expr->slot >= 0 || (mention(expr->name.lexeme), defined(expr->name.lexeme));
+        return variable && safe(expr->Operator.type, expr->operands);
+    }
+
+    std::any visitVarVarExpr(VarVarExpr *expr) override {
+        bool left = expr->leftSlot >= 0 || (mention(expr->left.lexeme), defined(expr->left.lexeme));
+        bool right = expr->rightSlot >= 0 || (mention(expr->right.lexeme), defined(expr->right.lexeme));
+        return left && right && safe(expr->Operator.type, expr->operands);
+    }
+
+    /* Statements, only their mentions are counted */
+
+    void visitExpressionStmt(ExpressionStmt *stmt) override {
+        visit(stmt->expression);
+    }
+
+    void visitPrintStmt(PrintStmt *stmt) override {
+        visit(stmt->expression);
+    }
+
+    void visitVarStmt(VarStmt *stmt) override {
+        visit(stmt->initializer);
+    }
+
+    void visitBlockStmt(BlockStmt *stmt) override {
+        visit(stmt->statements);
+    }
+
+    void visitFunStmt(FunStmt *stmt) override {
+        // a skimmed body is only tokens, every identifier in it counts as a mention
+        if (stmt->lazy) stmt->lazy->identifiers([&](const std::string& name) { mention(name); });
+        else visit(stmt->body);
+    }
+
+    void visitReturnStmt(ReturnStmt *stmt) override {
+        visit(stmt->value);
+    }
+
+    void visitIfStmt(IfStmt *stmt) override {
+        visit(stmt->condition);
+        visit(stmt->thenBranch);
+        visit(stmt->elseBranch);
+    }
+
+    void visitWhileStmt(WhileStmt *stmt) override {
+        visit(stmt->condition);
+        visit(stmt->body);
+        visit(stmt->increment);
+    }
+
+    void visitClassStmt(ClassStmt *stmt) override {
+        visit(stmt->superclass);
+        for (auto method : stmt->methods) visit(method);
+    }
+};
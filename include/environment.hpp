@@ -2,31 +2,155 @@
 
 #include <unordered_map>
 #include <any>
+#include <cstdint>
+#include <memory>
 
 #include "runtime_error.hpp"
+#include "stats.hpp"
 
+/*
+  The globals of one interpreter, in two layers. The prelude holds the
+  natives every interpreter starts with; it is built once and then shared,
+  read-only, by every interpreter and task in the process, so reading it
+  needs neither locks nor atomics. What the script defines goes into the
+  environment's own values, which are looked at first. Assigning to a name
+  that is only in the prelude copies it into the own values first, so the
+  prelude never changes once it is shared.
+
+  Variables stay where they are as long as the environment lives, except
+  that a prelude variable moves when it is copied. The version changes
+  whenever a name is added to the own values, which is what tells the
+  interpreter's loop caches that what they found may be out of date.
+*/
 class Environment {
-    std::unordered_map<std::string, std::any> values;
+public:
+    using Values = std::unordered_map<std::string, std::any>;
+
+private:
+    Values values;
+    std::shared_ptr<const Values> prelude;
+    uint64_t changes = 1;
+
+    // books one hash lookup and the length of the bucket it walks
+    static void probe(const Values& values, const std::string& name) {
+#if HD_STATS
+        HD_STAT(hashLookups);
+        if (values.bucket_count()) HD_STAT_ADD(hashProbes, values.bucket_size(values.bucket(name)));
+#else
+        (void) values;
+        (void) name;
+#endif
+    }
+
+    void probe(const std::string& name) const {
+        probe(values, name);
+    }
+
+    // the prelude's variable, null if it has none of that name
+    const std::any* shared(const std::string& name) const {
+        if (!prelude) return nullptr;
+
+        probe(*prelude, name);
+        if (auto it = prelude->find(name); it != prelude->end()) return &it->second;
+        return nullptr;
+    }
 
 public:
+    Environment() = default;
+
+    explicit Environment(std::shared_ptr<const Values> prelude) : prelude(std::move(prelude)) {}
+
+    uint64_t version() const {
+        return changes;
+    }
+
+    // for the environment of a task, which starts from the same prelude
+    const std::shared_ptr<const Values>& layer() const {
+        return prelude;
+    }
+
     void define(std::string name, std::any value) {
-        values.insert_or_assign(name, value);
+        HD_STAT(environmentDefines);
+        HD_STAT(anyCopies);
+        probe(name);
+        if (values.insert_or_assign(name, value).second) changes++;
     }
 
     void assign(Token name, std::any value) {
+        HD_STAT(environmentAssigns);
+        HD_STAT(anyCopies);
+        probe(name.lexeme);
         if (values.find(name.lexeme) != values.end()) {
+            probe(name.lexeme);
             values[name.lexeme] = value;
             return;
         }
 
+        if (shared(name.lexeme)) {
+            HD_STAT(preludeCopies);
+            values.emplace(name.lexeme, value);
+            changes++;
+            return;
+        }
+
+        throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+    }
+
+    bool has(const std::string& name) const {
+        return values.count(name) || shared(name);
+    }
+
+    // a variable the environment holds itself, null for prelude names and undefined ones
+    const std::any* own(const std::string& name) const {
+        auto it = values.find(name);
+        return it != values.end() ? &it->second : nullptr;
+    }
+
+    // the variables the environment holds itself, the prelude's are not visited
+    template <typename Visit>
+    void each(Visit visit) const {
+        for (auto &[name, value] : values) visit(name, value);
+    }
+
+    // the variable, with a single hash lookup unless it is in the prelude
+    const std::any& find(const Token& name) const {
+        HD_STAT(environmentGets);
+        probe(name.lexeme);
+        if (auto it = values.find(name.lexeme); it != values.end()) return it->second;
+        if (auto value = shared(name.lexeme)) return *value;
+
+        throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+    }
+
+    // the variable to write in place, copied out of the prelude first if it is there
+    std::any& target(const Token& name) {
+        HD_STAT(environmentGets);
+        probe(name.lexeme);
+        if (auto it = values.find(name.lexeme); it != values.end()) return it->second;
+
+        if (auto value = shared(name.lexeme)) {
+            HD_STAT(preludeCopies);
+            changes++;
+            return values.emplace(name.lexeme, *value).first->second;
+        }
+
         throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
     }
 
     std::any get(Token name) {
+        HD_STAT(environmentGets);
+        probe(name.lexeme);
         if (values.find(name.lexeme) != values.cend()) {
+            HD_STAT(anyCopies);
+            probe(name.lexeme);
             return values[name.lexeme];
         }
 
+        if (auto value = shared(name.lexeme)) {
+            HD_STAT(anyCopies);
+            return *value;
+        }
+
         throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
     }
-};
\ No newline at end of file
+};
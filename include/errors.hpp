@@ -1,11 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 
 #include "runtime_error.hpp"
 class Errors {
     public:
-    static inline bool hadError = false;
+    // the scanner and parser of a pipelined run report from their own threads
+    static inline std::atomic<bool> hadError{ false };
     static inline bool hadRuntimeError = false;
     
     static void report(int line, const std::string& where, const std::string& message) {
@@ -26,7 +28,7 @@ class Errors {
     }
 
     static void runtimeError(RuntimeError &e) {
-        std::cerr << "\n[line " + std::to_string(e.token.line) + "]: " << e.what() << "\n";
+        std::cerr << "\n[line " + std::to_string(e.line) + "]: " << e.what() << "\n";
         hadRuntimeError = true;
     }
 };
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "statement.hpp"
+
+// a user function as a runtime value. Functions do not capture anything, so
+// the declaration is all there is to it and the value stays pointer sized,
+// which keeps it inside std::any's small buffer
+struct LoxFunction {
+    FunStmt *declaration;
+
+    bool operator==(const LoxFunction& other) const {
+        return declaration == other.declaration;
+    }
+};
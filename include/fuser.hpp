@@ -0,0 +1,244 @@
+#pragma once
+
+#include <typeinfo>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "stats.hpp"
+
+/*
+  Rewrites common small shapes of the tree into superinstructions:
+
+    x = x + 1, x = x - k ...  ->  CompoundAssignExpr
+    x < 10, 2 * x ...         ->  VarLiteralExpr
+    a + b, i < n ...          ->  VarVarExpr
+
+  each of which the interpreter runs with one dispatch and one lookup per
+  variable instead of walking an Assign, a Binary and its operand nodes.
+  Runs after the Resolver and the TypeChecker and carries their slots and
+  proven operand types over to the fused node.
+*/
+class Fuser : public ExprVisitor, public StmtVisitor {
+
+    // replaces the expression in place when it fuses
+    void fuse(Expr *&expr) {
+        if (expr) expr = std::any_cast<Expr*>(expr->accept(this));
+    }
+
+    void fuse(Stmt *stmt) {
+        if (stmt) stmt->accept(this);
+    }
+
+    // the node as a T, or null; an exact type check is much cheaper than
+    // dynamic_cast and this runs for every operand in the program
+    template <typename T>
+    static T* as(Expr *expr) {
+        return expr && typeid(*expr) == typeid(T) ? static_cast<T*>(expr) : nullptr;
+    }
+
+    static bool arithmetic(TokenType type) {
+        return type == TokenType::PLUS || type == TokenType::MINUS ||
+               type == TokenType::STAR || type == TokenType::SLASH;
+    }
+
+    static bool same(VariableExpr *variable, const Token& name, int slot) {
+        return variable->slot == slot && variable->name.lexeme == name.lexeme;
+    }
+
+public:
+    void fuse(const std::vector<Stmt*>& statements) {
+        for (auto stmt : statements) fuse(stmt);
+    }
+
+    /* Expressions */
+
+    std::any visitBinaryExpr(BinaryExpr *expr) override {
+        fuse(expr->left);
+        fuse(expr->right);
+
+        auto leftVariable = as<VariableExpr>(expr->left);
+        auto rightVariable = as<VariableExpr>(expr->right);
+        auto leftLiteral = as<LiteralExpr>(expr->left);
+        auto rightLiteral = as<LiteralExpr>(expr->right);
+
+        Expr *fused = nullptr;
+
+        if (leftVariable && rightVariable) {
+            auto both = new VarVarExpr(leftVariable->name, expr->Operator, rightVariable->name);
+            both->leftSlot = leftVariable->slot;
+            both->rightSlot = rightVariable->slot;
+            both->leftCache = leftVariable->cache;
+            both->rightCache = rightVariable->cache;
+            both->operands = expr->operands;
+
+            HD_STAT(fusedVarVars);
+            fused = both;
+        } else if ((leftVariable && rightLiteral) || (leftLiteral && rightVariable)) {
+            VariableExpr *variable = leftVariable ? leftVariable : rightVariable;
+            LiteralExpr *literal = leftLiteral ? leftLiteral : rightLiteral;
+
+            auto one = new VarLiteralExpr(variable->name, expr->Operator, literal->value);
+            one->slot = variable->slot;
+            one->cache = variable->cache;
+            one->literalFirst = leftLiteral != nullptr;
+            one->operands = expr->operands;
+
+            HD_STAT(fusedVarLiterals);
+            fused = one;
+        }
+
+        if (!fused) return static_cast<Expr*>(expr);
+
+        delete expr;
+        return fused;
+    }
+
+    std::any visitAssignExpr(AssignExpr *expr) override {
+        auto binary = as<BinaryExpr>(expr->value);
+        auto variable = binary ? as<VariableExpr>(binary->left) : nullptr;
+        auto literal = binary ? as<LiteralExpr>(binary->right) : nullptr;
+
+        if (variable && literal && arithmetic(binary->Operator.type) && same(variable, expr->name, expr->slot)) {
+            auto fused = new CompoundAssignExpr(expr->name, binary->Operator, literal->value);
+            fused->slot = expr->slot;
+            fused->cache = expr->cache;
+            fused->operands = binary->operands;
+
+            HD_STAT(fusedCompoundAssigns);
+            delete expr;
+            return static_cast<Expr*>(fused);
+        }
+
+        fuse(expr->value);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitGroupingExpr(GroupingExpr *expr) override {
+        fuse(expr->expression);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitLiteralExpr(LiteralExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitUnaryExpr(UnaryExpr *expr) override {
+        fuse(expr->right);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitVariableExpr(VariableExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitCallExpr(CallExpr *expr) override {
+        // the callee stays, the Resolver pointed property and superMethod at it
+        for (auto &arg : expr->arguments) fuse(arg);
+        if (!expr->property && !expr->superMethod) fuse(expr->callee);
+        else if (expr->property) fuse(expr->property->object);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitGetExpr(GetExpr *expr) override {
+        fuse(expr->object);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitSetExpr(SetExpr *expr) override {
+        fuse(expr->object);
+        fuse(expr->value);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitThisExpr(ThisExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitSuperExpr(SuperExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitArrayExpr(ArrayExpr *expr) override {
+        for (auto &element : expr->elements) fuse(element);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitIndexExpr(IndexExpr *expr) override {
+        fuse(expr->object);
+        fuse(expr->index);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override {
+        fuse(expr->object);
+        fuse(expr->index);
+        fuse(expr->value);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitSpawnExpr(SpawnExpr *expr) override {
+        expr->call->accept(this);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitAwaitExpr(AwaitExpr *expr) override {
+        fuse(expr->task);
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    std::any visitVarVarExpr(VarVarExpr *expr) override {
+        return static_cast<Expr*>(expr);
+    }
+
+    /* Statements */
+
+    void visitExpressionStmt(ExpressionStmt *stmt) override {
+        fuse(stmt->expression);
+    }
+
+    void visitPrintStmt(PrintStmt *stmt) override {
+        fuse(stmt->expression);
+    }
+
+    void visitVarStmt(VarStmt *stmt) override {
+        fuse(stmt->initializer);
+    }
+
+    void visitBlockStmt(BlockStmt *stmt) override {
+        fuse(stmt->statements);
+    }
+
+    void visitFunStmt(FunStmt *stmt) override {
+        fuse(stmt->body);
+    }
+
+    void visitReturnStmt(ReturnStmt *stmt) override {
+        // calls are never replaced, so tail calls stay tail calls
+        fuse(stmt->value);
+    }
+
+    void visitIfStmt(IfStmt *stmt) override {
+        fuse(stmt->condition);
+        fuse(stmt->thenBranch);
+        fuse(stmt->elseBranch);
+    }
+
+    void visitWhileStmt(WhileStmt *stmt) override {
+        fuse(stmt->condition);
+        fuse(stmt->body);
+        fuse(stmt->increment);
+    }
+
+    void visitClassStmt(ClassStmt *stmt) override {
+        for (auto method : stmt->methods) fuse(method);
+    }
+};
@@ -1,24 +1,72 @@
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <typeinfo>
 
 #include "string_util.hpp"
 #include "scanner.hpp"
+#include "parallel_scanner.hpp"
 #include "errors.hpp"
 #include "parser.hpp"
 #include "ast_printer.hpp"
 #include "interpreter.hpp"
+#include "resolver.hpp"
+#include "type_checker.hpp"
+#include "fuser.hpp"
+#include "dead_code.hpp"
+#include "profiler.hpp"
+#include "stats.hpp"
+#include "perf_counters.hpp"
+#include "spsc_queue.hpp"
+#include "cpp_emitter.hpp"
 
 class HD {
 
     Interpreter interpreter;
 
-    void run(const std::string& input) {
-        Scanner scanner(input);
-        std::vector<Token> tokens = scanner.scanTokens();
+    std::unique_ptr<Profiler> profiler;
+    std::string flamegraphPath;
 
-        auto parser = std::make_unique<Parser>(tokens);
+    std::unique_ptr<PerfCounters> perfCounters;
 
-        auto statements = parser->parse();
+    enum class StatsFormat { None, Text, Json } statsFormat = StatsFormat::None;
+
+    bool fuse = true;
+    bool lazy = true;
+    bool eliminate = true;
+    bool stream = false;
+    bool emitCpp = false;
+    size_t scanThreads = 1;
+
+    // tokens per batch handed from the scanner to the parser of a pipelined run
+    static constexpr size_t TOKEN_BATCH = 4096;
+
+    // whole is false at the prompt, where later lines may mention anything defined now
+    void run(const std::string& input, bool whole = false) {
+        std::vector<Token> tokens;
+        {
+            Stats::PhaseScope phase(Phase::Scan);
+            PerfCounters::Scope counters(perfCounters.get(), Phase::Scan);
+            if (scanThreads > 1) {
+                tokens = ParallelScanner::scanTokens(input, scanThreads);
+            } else {
+                Scanner scanner(input);
+                tokens = scanner.scanTokens();
+            }
+        }
+
+        std::vector<Stmt*> statements;
+        {
+            Stats::PhaseScope phase(Phase::Parse);
+            PerfCounters::Scope counters(perfCounters.get(), Phase::Parse);
+            auto parser = std::make_unique<Parser>(std::move(tokens), lazy);
+            statements = parser->parse();
+
+            if (!Errors::hadError) Resolver().resolve(statements);
+            if (!Errors::hadError) TypeChecker().check(statements);
+            if (!Errors::hadError && whole && eliminate) eliminateDeadCode(statements);
+            if (!Errors::hadError && fuse) Fuser().fuse(statements);
+        }
 
         if (Errors::hadError) return;
 
@@ -27,17 +75,234 @@ class HD {
 
         // std::cout << "\n";
 
+        Stats::PhaseScope phase(Phase::Interpret);
+        PerfCounters::Scope counters(perfCounters.get(), Phase::Interpret);
         interpreter.interpret(statements);
     }
 
+    void eliminateDeadCode(std::vector<Stmt*>& statements) {
+        DeadCodeEliminator([this](const std::string& name) { return interpreter.defines(name); }).eliminate(statements);
+    }
+
+    // statements that can't have declared a function or a class, nothing
+    // refers to them once they ran
+    static bool disposable(Stmt *stmt) {
+        auto &type = typeid(*stmt);
+        return type == typeid(ExpressionStmt) || type == typeid(PrintStmt) || type == typeid(VarStmt);
+    }
+
+    /*
+      Pipelined run for huge scripts: the scanner, the parser and the
+      interpreter run on threads of their own, handing token batches and top
+      level statements down bounded queues. A statement runs as soon as it is
+      parsed and resolved, and is freed right after unless it declared
+      something the program keeps using (or the profiler holds on to it).
+
+      Unlike run(), an error in the source does not keep the whole script from
+      running. Statements that end before the first error run, later ones are
+      only parsed so that every error is still reported.
+    */
+    void runStreaming(const std::string& input) {
+        struct Batch {
+            std::vector<Token> tokens;
+            // first scanner error so far, 0 for none
+            int errorLine = 0;
+        };
+
+        SpscQueue<Batch> batches(16);
+        SpscQueue<Stmt*> statements(256);
+
+        std::thread scanning([&] {
+            {
+                Stats::PhaseScope phase(Phase::Scan);
+                Scanner scanner(input);
+
+                Batch batch;
+                while (scanner.scanBatch(batch.tokens, TOKEN_BATCH)) {
+                    batch.errorLine = scanner.firstErrorLine();
+                    if (!batches.push(batch)) break;
+                }
+                batches.close();
+            }
+            Stats::flushThread();
+        });
+
+        std::thread parsing([&] {
+            {
+                Stats::PhaseScope phase(Phase::Parse);
+
+                int scanErrorLine = 0;
+                Parser parser([&](std::vector<Token>& tokens) {
+                    Batch batch;
+                    if (!batches.pop(batch)) return false;
+
+                    if (!scanErrorLine) scanErrorLine = batch.errorLine;
+                    tokens = std::move(batch.tokens);
+                    return true;
+                });
+
+                Resolver resolver;
+                TypeChecker checker;
+                bool running = true;
+
+                for (Stmt *stmt; parser.parseNext(stmt); ) {
+                    running = running && !parser.hadError() && (!scanErrorLine || parser.line() < scanErrorLine);
+
+                    if (running) {
+                        std::vector<Stmt*> single{ stmt };
+                        resolver.resolve(single);
+                        running = !resolver.hadError();
+                        if (running) checker.check(single);
+                        if (running && fuse) Fuser().fuse(single);
+                    }
+
+                    if (!running) {
+                        delete stmt;
+                        continue;
+                    }
+
+                    // the interpreter stopped at a runtime error
+                    if (!statements.push(stmt)) {
+                        delete stmt;
+                        break;
+                    }
+                }
+                statements.close();
+            }
+            Stats::flushThread();
+        });
+
+        {
+            Stats::PhaseScope phase(Phase::Interpret);
+            PerfCounters::Scope counters(perfCounters.get(), Phase::Interpret);
+
+            Stmt *current = nullptr;
+            auto release = [&] {
+                if (current && !profiler && disposable(current)) delete current;
+                current = nullptr;
+            };
+
+            interpreter.interpret([&]() -> Stmt* {
+                release();
+                if (!statements.pop(current)) current = nullptr;
+                return current;
+            });
+            release();
+        }
+
+        statements.cancel();
+        batches.cancel();
+        parsing.join();
+        scanning.join();
+
+        for (Stmt *stmt; statements.tryPop(stmt); ) delete stmt;
+    }
+
+    // translates the script to C++ on stdout instead of running it
+    void emit(const std::string& input, const std::string& path) {
+        std::vector<Token> tokens = scanThreads > 1 ? ParallelScanner::scanTokens(input, scanThreads) : Scanner(input).scanTokens();
+
+        // every body is needed, so nothing is parsed lazily
+        std::vector<Stmt*> statements = Parser(std::move(tokens), false).parse();
+        if (!Errors::hadError) Resolver().resolve(statements);
+        if (!Errors::hadError) TypeChecker().check(statements);
+        if (!Errors::hadError && eliminate) eliminateDeadCode(statements);
+        if (Errors::hadError) return;
+
+        CppEmitter(interpreter.maxCallDepth).emit(statements, path, std::cout);
+    }
+
     public:
+
+    // collapsedPath, if not empty, receives the stacks in flamegraph.pl format
+    void enableProfiling(const std::string& collapsedPath = "") {
+        profiler = std::make_unique<Profiler>();
+        flamegraphPath = collapsedPath;
+        interpreter.profiler = profiler.get();
+    }
+
+    void setMaxCallDepth(size_t depth) {
+        interpreter.maxCallDepth = depth;
+    }
+
+    // superinstruction fusion is on by default, turning it off is for comparing
+    void setFusion(bool enabled) {
+        fuse = enabled;
+        interpreter.fuse = enabled;
+    }
+
+    // stop runs after this many statements, 0 for no limit
+    void setFuel(uint64_t statements) {
+        interpreter.maxFuel = statements;
+    }
+
+    // stop runs once the process holds more than this many heap bytes, 0 for no cap
+    void setMaxHeap(size_t bytes) {
+        if (bytes && !Heap::supported) std::cerr << "--max-heap needs glibc to measure the heap, ignoring it\n";
+
+        interpreter.maxHeap = bytes;
+        Heap::tracking = bytes != 0;
+    }
+
+    // threads scanning a large source, 0 for one per core. Streaming runs scan on one
+    void setScanThreads(size_t threads) {
+        scanThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // scan, parse and run a file on three threads at once, see runStreaming()
+    void setStreaming(bool enabled) {
+        stream = enabled;
+    }
+
+    // top level function bodies are parsed on their first call by default
+    void setLazyParsing(bool enabled) {
+        lazy = enabled;
+    }
+
+    // hd --no-dce, see dead_code.hpp
+    void setDeadCodeElimination(bool enabled) {
+        eliminate = enabled;
+    }
+
+    // hd --emit-cpp, see cpp_emitter.hpp
+    void setEmitCpp(bool enabled) {
+        emitCpp = enabled;
+    }
+
+    void enablePerfCounters() {
+        perfCounters = std::make_unique<PerfCounters>();
+    }
+
+    void enableStats(bool json) {
+        statsFormat = json ? StatsFormat::Json : StatsFormat::Text;
+    }
     
     int runFile(const std::string& path) {
         std::ifstream file(path);
 
         std::string contents = slurp(file);
 
-        run(contents);
+        if (emitCpp) {
+            emit(contents, path);
+            return Errors::hadError ? 65 : 0;
+        }
+
+        if (stream) runStreaming(contents);
+        else run(contents, true);
+
+        if (profiler) {
+            profiler->report(contents, std::cerr);
+
+            if (!flamegraphPath.empty()) {
+                std::ofstream out(flamegraphPath);
+                profiler->writeCollapsed(out);
+            }
+        }
+
+        if (perfCounters) perfCounters->report(std::cerr);
+
+        if (statsFormat == StatsFormat::Text) Stats::report(std::cerr);
+        if (statsFormat == StatsFormat::Json) Stats::reportJson(std::cerr);
 
         if (Errors::hadError) return 65;
 
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/*
+  Live heap bytes of the whole process, for hd --max-heap. The allocation
+  hook in stats.hpp reports every allocation and free here while tracking
+  is on. Sizes are what malloc really reserved, so a free takes off exactly
+  what its allocation added. Each thread collects its changes locally and
+  only adds them to the shared count once they pass FLUSH bytes either way,
+  so the count is off by at most that much per thread.
+*/
+class Heap {
+public:
+    static inline std::atomic<bool> tracking{ false };
+    static inline std::atomic<int64_t> live{ 0 };
+
+    static constexpr int64_t FLUSH = 64 * 1024;
+    static inline thread_local int64_t pending = 0;
+
+    static void add(int64_t bytes) {
+        pending += bytes;
+        if (pending > FLUSH || pending < -FLUSH) {
+            live.fetch_add(pending, std::memory_order_relaxed);
+            pending = 0;
+        }
+    }
+
+#if defined(__GLIBC__)
+    static constexpr bool supported = true;
+
+    static size_t usable(void *ptr) {
+        return malloc_usable_size(ptr);
+    }
+#else
+    static constexpr bool supported = false;
+
+    static size_t usable(void *) {
+        return 0;
+    }
+#endif
+
+    static void allocated(void *ptr) {
+        if (tracking.load(std::memory_order_relaxed)) add(static_cast<int64_t>(usable(ptr)));
+    }
+
+    static void freed(void *ptr) {
+        if (ptr && tracking.load(std::memory_order_relaxed)) add(-static_cast<int64_t>(usable(ptr)));
+    }
+
+    static int64_t bytes() {
+        return live.load(std::memory_order_relaxed);
+    }
+};
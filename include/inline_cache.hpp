@@ -0,0 +1,39 @@
+#pragma once
+
+class Shape;
+class FunStmt;
+class LoxClass;
+
+/*
+  Per site cache for property access. Each entry remembers, for one shape of
+  the receiver, where the property was found: a field slot, a method, or for
+  stores that add a field the shape the instance moves to. One entry is a
+  monomorphic site, up to WAYS a polymorphic one; sites that see more shapes
+  than that stop caching and always do the full lookup.
+*/
+struct InlineCache {
+    static constexpr int WAYS = 4;
+
+    struct Entry {
+        const Shape *shape;
+        int slot;
+        FunStmt *method;
+        // the class that declared method, shapes belong to one class so this is fixed too
+        LoxClass *owner;
+        Shape *transition;
+    };
+
+    Entry entries[WAYS];
+    int size = 0;
+
+    const Entry* find(const Shape *shape) const {
+        for (int i = 0; i < size; i++) {
+            if (entries[i].shape == shape) return &entries[i];
+        }
+        return nullptr;
+    }
+
+    void add(const Entry& entry) {
+        if (size < WAYS) entries[size++] = entry;
+    }
+};
@@ -1,74 +1,790 @@
 #pragma once
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "expression.hpp"
 #include "errors.hpp"
 #include "runtime_error.hpp"
 // #include "statement.hpp"
 #include "environment.hpp"
+#include "function.hpp"
+#include "class.hpp"
+#include "native.hpp"
+#include "number.hpp"
+#include "builtins.hpp"
+#include "array.hpp"
+#include "map.hpp"
+#include "task.hpp"
+#include "profiler.hpp"
+#include "stats.hpp"
+#include "heap.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "type_checker.hpp"
+#include "fuser.hpp"
 
 class Interpreter final : public ExprVisitor, public StmtVisitor {
 
+    // every class ever declared; they are referenced by raw pointer from values
+    std::vector<std::unique_ptr<LoxClass>> classes;
+
     Environment environment;
 
+    // call stack of frames holding the locals, indexed by fp + the slot the
+    // Resolver assigned. It only ever grows, so entering and leaving blocks
+    // and functions does not allocate
+    std::vector<std::any> stack;
+
+    // base of the current frame and first free slot above it
+    size_t fp = 0, sp = 0;
+
+    size_t callDepth = 0;
+
+    // the class that declared the running method, 'super' searches its superclass
+    LoxClass *methodClass = nullptr;
+
+    // the globals of the running loops, each loop's entries start at its
+    // cacheBase, see WhileStmt::globals. An entry is filled on its first use
+    // after the loop is entered and trusted for as long as the environment
+    // keeps its version
+    struct CachedGlobal {
+        const std::any *value = nullptr;
+        // set once the loop wrote the global, which then lives in the environment's own values
+        std::any *target = nullptr;
+        uint64_t version = 0;
+    };
+    std::vector<CachedGlobal> globalCache;
+    size_t cacheBase = 0, cacheTop = 0;
+
+    // set by a return statement, every statement list stops executing when it sees it
+    bool returning = false;
+    std::any returnValue;
+
+    // a return in tail position leaves the callee here and its arguments at
+    // stack[tailBase...], the frame of the returning function is then reused
+    FunStmt *tailCallee = nullptr;
+    size_t tailBase = 0, tailArgs = 0;
+
+    // fuel is handed out in batches, so the hot path only counts down tick;
+    // the limits are looked at in checkpoint() once per batch
+    static constexpr uint64_t FUEL_BATCH = 1024;
+    int64_t tick = 0;
+    // statements paid for so far, including the rest of the current batch
+    uint64_t burned = 0;
+
+    // natives registered through defineNative, the deque keeps their addresses stable
+    std::deque<NativeDef> hostNatives;
+
+    // created by the first spawn and shared with the interpreters running the tasks
+    std::unique_ptr<TaskPool> ownedPool;
+    TaskPool *pool = nullptr;
+
+    // tasks spawned from here, waited for before interpret() or the task returns
+    std::vector<std::shared_ptr<TaskState>> spawned;
+
+    // interpreters running a task print into the task's buffer and can't declare classes
+    bool inTask = false;
+    std::ostream *out = &std::cout;
+
+    Interpreter(TaskPool *pool, Environment globals, std::ostream &out)
+    : environment(std::move(globals)), pool(pool), inTask(true), out(&out) {}
+
+    void reserve(size_t size) {
+        if (stack.size() < size) stack.resize(std::max(size, stack.size() * 2));
+    }
+
+    void clearSlots(size_t from, size_t to) {
+        for (size_t slot = from; slot < to; slot++) stack[slot].reset();
+    }
+
+    void execute(const std::vector<Stmt*>& statements) {
+        for (auto stmt : statements) {
+            evaluate(stmt);
+            if (returning) return;
+        }
+    }
+
+    // evaluates the arguments onto the top of the stack, returns where they start
+    size_t pushArguments(const std::vector<Expr*>& arguments) {
+        size_t base = sp;
+
+        for (auto arg : arguments) {
+            std::any value = evaluate(arg);
+            reserve(sp + 1);
+            stack[sp++] = std::move(value);
+        }
+
+        return base;
+    }
+
+    void checkArity(FunStmt *function, size_t count, Mark paren) {
+        if (count == function->params.size()) return;
+
+        throw RuntimeError(paren, "Expected " + std::to_string(function->params.size()) +
+                                  " arguments but got " + std::to_string(count) + ".");
+    }
+
+    std::any call(const std::any& callee, CallExpr *expr) {
+        if (callee.type() == typeid(LoxFunction)) {
+            FunStmt *function = cast<LoxFunction>(callee).declaration;
+            size_t base = pushArguments(expr->arguments);
+            checkArity(function, sp - base, expr->paren);
+
+            return call(function, base, expr->paren);
+        }
+
+        if (callee.type() == typeid(LoxNative)) return callNative(cast<LoxNative>(callee).def, expr);
+
+        if (callee.type() == typeid(LoxClass*)) return instantiate(cast<LoxClass*>(callee), expr);
+
+        if (callee.type() == typeid(Ref<LoxBoundMethod>)) {
+            auto bound = cast<Ref<LoxBoundMethod>>(callee);
+            return invoke(bound->receiver, bound->method, expr);
+        }
+
+        throw RuntimeError(expr->paren, "Can only call functions and classes.");
+    }
+
+    std::any callNative(const NativeDef *native, CallExpr *expr) {
+        HD_STAT(nativeCalls);
+
+        // number to number natives get their arguments unboxed and are called directly
+        if (native->unary && expr->arguments.size() == 1) {
+            double x;
+            if (!number::get(evaluate(expr->arguments[0]), x)) throw RuntimeError(expr->paren, "Expected a number.");
+
+            HD_STAT(nativeDirectCalls);
+            return native->unary(x);
+        }
+
+        if (native->binary && expr->arguments.size() == 2) {
+            double x, y;
+            bool numbers = number::get(evaluate(expr->arguments[0]), x);
+            numbers = number::get(evaluate(expr->arguments[1]), y) && numbers;
+            if (!numbers) throw RuntimeError(expr->paren, "Expected a number.");
+
+            HD_STAT(nativeDirectCalls);
+            return native->binary(x, y);
+        }
+
+        size_t base = pushArguments(expr->arguments);
+        size_t count = sp - base;
+
+        if (count != native->arity) {
+            clearSlots(base, sp);
+            sp = base;
+            throw RuntimeError(expr->paren, "Expected " + std::to_string(native->arity) +
+                                            " arguments but got " + std::to_string(count) + ".");
+        }
+
+        std::any result = native->function(stack.data() + base, expr->paren);
+        clearSlots(base, sp);
+        sp = base;
+
+        return result;
+    }
+
+    std::any instantiate(LoxClass *klass, CallExpr *expr) {
+        auto instance = make<LoxInstance>(klass);
+
+        if (klass->initializer.function) {
+            invoke(instance, klass->initializer, expr);
+            return instance;
+        }
+
+        size_t base = pushArguments(expr->arguments);
+        size_t count = sp - base;
+        clearSlots(base, sp);
+        sp = base;
+
+        if (count != 0) {
+            throw RuntimeError(expr->paren, "Expected 0 arguments but got " + std::to_string(count) + ".");
+        }
+
+        return instance;
+    }
+
+    // calls a method with the receiver in slot 0 of its frame
+    std::any invoke(const Ref<LoxInstance>& receiver, Method method, CallExpr *expr) {
+        size_t base = sp;
+        reserve(sp + 1);
+        stack[sp++] = receiver;
+
+        pushArguments(expr->arguments);
+        checkArity(method.function, sp - base - 1, expr->paren);
+
+        // the arguments were evaluated in the caller's method, the body runs in this one
+        LoxClass *callerClass = methodClass;
+        methodClass = method.owner;
+        std::any result = call(method.function, base, expr->paren);
+        methodClass = callerClass;
+
+        return result;
+    }
+
+    Ref<LoxArray>* asArray(std::any& value) {
+        HD_STAT(anyCasts);
+        return std::any_cast<Ref<LoxArray>>(&value);
+    }
+
+    LoxMap* asMap(std::any& value, Mark bracket) {
+        HD_STAT(anyCasts);
+        if (auto map = std::any_cast<Ref<LoxMap>>(&value)) return map->get();
+        throw RuntimeError(bracket, "Only arrays and maps can be indexed.");
+    }
+
+    // a literal key interned by the Resolver skips evaluating and hashing the
+    // index. Other indexes are evaluated into value, which a string key points into
+    MapKey mapKey(const Symbol *key, Expr *index, Mark bracket, std::any &value) {
+        if (key) {
+            HD_STAT(internedKeyHits);
+            return MapKey::of(key);
+        }
+
+        value = evaluate(index);
+        try {
+            return map::key(value);
+        } catch (NativeError &e) {
+            throw RuntimeError(bracket, e.what());
+        }
+    }
+
+    size_t index(const std::any& value, LoxArray *array, Mark bracket) {
+        HD_STAT(anyCasts);
+        if (auto integer = std::any_cast<int64_t>(&value)) {
+            if (*integer < 0 || static_cast<uint64_t>(*integer) >= array->size()) throw RuntimeError(bracket, "Array index out of bounds.");
+            return static_cast<size_t>(*integer);
+        }
+
+        auto real = std::any_cast<double>(&value);
+        if (!real || *real != std::floor(*real)) throw RuntimeError(bracket, "Array index must be an integer.");
+        if (*real < 0 || *real >= array->size()) throw RuntimeError(bracket, "Array index out of bounds.");
+
+        return static_cast<size_t>(*real);
+    }
+
+    using Copies = std::unordered_map<const Object*, std::any>;
+
+    /*
+      Tasks share nothing mutable with their spawner: arguments and globals
+      are deep copied into the task, and the result is handed over only once
+      the task's interpreter is gone. Classes, instances and tasks can't be
+      copied, so they never cross; the copy fails and this returns false.
+      The functions met on the way are added to functions, the task can call
+      them and so reach the globals they mention.
+    */
+    bool send(const std::any& value, std::any& copy, Copies& copies, std::vector<FunStmt*>& functions) {
+        if (auto function = std::any_cast<LoxFunction>(&value)) {
+            functions.push_back(function->declaration);
+            copy = value;
+            return true;
+        }
+
+        if (!value.has_value() || value.type() == typeid(nullptr_t) || number::is(value) ||
+            value.type() == typeid(bool) || value.type() == typeid(std::string) ||
+            value.type() == typeid(LoxNative)) {
+            copy = value;
+            return true;
+        }
+
+        if (auto array = std::any_cast<Ref<LoxArray>>(&value)) {
+            if (auto seen = copies.find(array->get()); seen != copies.end()) {
+                copy = seen->second;
+                return true;
+            }
+
+            auto result = make<LoxArray>();
+            copies[array->get()] = result;
+
+            result->packed = (*array)->packed;
+            result->numbers = (*array)->numbers;
+            for (auto &element : (*array)->values) {
+                result->values.emplace_back();
+                if (!send(element, result->values.back(), copies, functions)) return false;
+            }
+
+            copy = result;
+            return true;
+        }
+
+        if (auto map = std::any_cast<Ref<LoxMap>>(&value)) {
+            if (auto seen = copies.find(map->get()); seen != copies.end()) {
+                copy = seen->second;
+                return true;
+            }
+
+            auto result = make<LoxMap>();
+            copies[map->get()] = result;
+
+            result->count = (*map)->count;
+            result->entries.resize((*map)->entries.size());
+            for (size_t i = 0; i < result->entries.size(); i++) {
+                auto &from = (*map)->entries[i];
+                auto &to = result->entries[i];
+
+                to.key = LoxMap::keep(from.key);
+                to.distance = from.distance;
+                if (!send(from.value, to.value, copies, functions)) return false;
+            }
+
+            copy = result;
+            return true;
+        }
+
+        return false;
+    }
+
+    // runs a spawned function with its arguments, on whichever thread took the task
+    std::any runTask(FunStmt *function, std::vector<std::any>& args, Mark paren) {
+        reserve(args.size());
+        for (auto &arg : args) stack[sp++] = std::move(arg);
+
+        std::any result;
+        try {
+            result = call(function, 0, paren);
+        } catch (RuntimeError &) {
+            waitForTasks();
+            throw;
+        }
+
+        finishTasks();
+        return result;
+    }
+
+    void waitForTasks() {
+        for (auto &state : spawned) pool->wait(*state);
+    }
+
+    // tasks nobody awaited still run to completion, their output and errors come out in spawn order
+    void finishTasks() {
+        waitForTasks();
+
+        // await marks a task before rethrowing its error, so after a throw this can be called again
+        for (auto &state : spawned) {
+            if (!state->awaited) await(*state);
+        }
+
+        spawned.clear();
+    }
+
+    std::any await(TaskState &state) {
+        pool->wait(state);
+
+        if (!state.awaited) {
+            state.awaited = true;
+            *out << state.output.str();
+            state.output.str("");
+        }
+
+        if (state.error) throw *state.error;
+        return state.result;
+    }
+
+    Ref<LoxInstance>* asInstance(std::any& value) {
+        HD_STAT(anyCasts);
+        return std::any_cast<Ref<LoxInstance>>(&value);
+    }
+
+    // where a property of an instance lives, answered by the site's inline cache when it can
+    InlineCache::Entry property(LoxInstance *instance, InlineCache &cache, const Token &name) {
+        if (auto hit = cache.find(instance->shape)) {
+            HD_STAT(inlineCacheHits);
+            return *hit;
+        }
+
+        HD_STAT(inlineCacheMisses);
+        InlineCache::Entry entry{ instance->shape, instance->shape->find(name.lexeme), nullptr, nullptr, nullptr };
+
+        if (entry.slot < 0) {
+            Method method = instance->klass->findMethod(name.lexeme);
+            if (!method.function) throw RuntimeError(name, "Undefined property '" + name.lexeme + "'.");
+
+            entry.method = method.function;
+            entry.owner = method.owner;
+        }
+
+        cache.add(entry);
+        return entry;
+    }
+
+    // super only appears right in a method's body, which is what methodClass is for
+    Method superMethod(SuperExpr *expr) {
+        Method method = methodClass->superclass->findMethod(expr->method.lexeme);
+
+        if (!method.function) throw RuntimeError(expr->method, "Undefined property '" + expr->method.lexeme + "'.");
+        return method;
+    }
+
+    // builds the body of a function the Parser only skimmed and runs the
+    // static passes over it, once; tasks may get here for the same function
+    // at the same time
+    void parseBody(FunStmt *function) {
+        LazyBody &lazy = *function->lazy;
+
+        std::call_once(lazy.parsed, [&] {
+            HD_STAT(lazyParses);
+            function->body = Parser(lazy.tokens).parseBody(lazy.start);
+
+            Resolver resolver;
+            resolver.resolve(function);
+            lazy.failed = resolver.hadError();
+            TypeChecker().check(function);
+            if (fuse) Fuser().fuse(function->body);
+        });
+
+        if (lazy.failed) {
+            throw RuntimeError(function->name, "Can't run '" + function->name.lexeme + "', its body has errors.");
+        }
+    }
+
+    // runs a function whose arguments are already at stack[base...]
+    std::any call(FunStmt *function, size_t base, Mark paren) {
+        if (callDepth >= maxCallDepth) {
+            throw RuntimeError(paren, "Stack overflow: call depth exceeded " + std::to_string(maxCallDepth) + ".");
+        }
+
+        HD_STAT(functionCalls);
+        callDepth++;
+        size_t callerFp = fp;
+        fp = base;
+
+        while (true) {
+            if (function->lazy) parseBody(function);
+
+            sp = fp + function->slotCount;
+            reserve(sp);
+
+            execute(function->body);
+
+            if (!tailCallee) break;
+
+            // proper tail call: move the new arguments down into this frame and go again
+            HD_STAT(tailCalls);
+            function = tailCallee;
+            tailCallee = nullptr;
+            returning = false;
+
+            for (size_t i = 0; i < tailArgs; i++) stack[fp + i] = std::move(stack[tailBase + i]);
+            clearSlots(fp + tailArgs, tailBase + tailArgs);
+        }
+
+        std::any result;
+        if (function->kind == FunctionKind::Initializer) {
+            // init always hands back the instance, even after a bare return
+            result = stack[fp];
+            returnValue.reset();
+            returning = false;
+        } else if (returning) {
+            result = std::move(returnValue);
+            returnValue.reset();
+            returning = false;
+        }
+
+        clearSlots(fp, sp);
+        sp = base;
+        fp = callerFp;
+        callDepth--;
+
+        return result;
+    }
+
     std::any evaluate(Expr *expr) {
+        if (profiler) {
+            Profiler::Scope scope(*profiler, expr);
+            return expr->accept(this);
+        }
+
         return expr->accept(this);
     }
 
+    // the statement about to run found its batch of fuel used up
+    [[gnu::noinline]] void checkpoint(Stmt *stmt) {
+        if (maxFuel && burned >= maxFuel) {
+            throw RuntimeError(LineFinder().of(stmt), "Out of fuel: ran " + std::to_string(maxFuel) + " statements.");
+        }
+
+        if (maxHeap && Heap::bytes() > static_cast<int64_t>(maxHeap)) {
+            throw RuntimeError(LineFinder().of(stmt), "Out of memory: heap exceeded " + std::to_string(maxHeap) + " bytes.");
+        }
+
+        uint64_t batch = maxFuel ? std::min(FUEL_BATCH, maxFuel - burned) : FUEL_BATCH;
+        burned += batch;
+        tick = batch - 1;
+    }
+
     void evaluate(Stmt *stmt) {
+        if (--tick < 0) checkpoint(stmt);
+        execute(stmt);
+    }
+
+    // runs the statement without burning fuel for it
+    void execute(Stmt *stmt) {
+        if (profiler) {
+            Profiler::Scope scope(*profiler, stmt);
+            stmt->accept(this);
+            return;
+        }
+
         stmt->accept(this);
     }
 
+    // any_cast that shows up in --stats
+    template <typename T>
+    T cast(const std::any& value) {
+        HD_STAT(anyCasts);
+        return std::any_cast<T>(value);
+    }
+
+    static bool comparison(TokenType type) {
+        return type == TokenType::GREATER || type == TokenType::GREATER_EQUAL || type == TokenType::LESS ||
+               type == TokenType::LESS_EQUAL || type == TokenType::EQUAL_EQUAL || type == TokenType::BANG_EQUAL;
+    }
+
+    // a comparison operator as a C++ bool, with the same checks and errors as binary()
+    bool compare(Mark Operator, Operands operands, const std::any& left, const std::any& right) {
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wswitch"
+
+        double x, y;
+
+        if (auto a = std::any_cast<int64_t>(&left), b = std::any_cast<int64_t>(&right); a && b) {
+            HD_STAT(integerOps);
+
+            switch (Operator.type) {
+                case TokenType::GREATER:       return *a > *b;
+                case TokenType::GREATER_EQUAL: return *a >= *b;
+                case TokenType::LESS:          return *a < *b;
+                case TokenType::LESS_EQUAL:    return *a <= *b;
+                case TokenType::BANG_EQUAL:    return *a != *b;
+                case TokenType::EQUAL_EQUAL:   return *a == *b;
+            }
+        }
+
+        if (operands == Operands::Numbers) {
+            HD_STAT(uncheckedOps);
+            x = number::unchecked(left);
+            y = number::unchecked(right);
+        } else if (Operator.type == TokenType::EQUAL_EQUAL) {
+            return isEqual(left, right);
+        } else if (Operator.type == TokenType::BANG_EQUAL) {
+            return !isEqual(left, right);
+        } else {
+            std::tie(x, y) = numberOperands(Operator, left, right);
+        }
+
+        switch (Operator.type) {
+            case TokenType::GREATER:       return x > y;
+            case TokenType::GREATER_EQUAL: return x >= y;
+            case TokenType::LESS:          return x < y;
+            case TokenType::LESS_EQUAL:    return x <= y;
+            case TokenType::BANG_EQUAL:    return x != y;
+            case TokenType::EQUAL_EQUAL:   return x == y;
+        }
+        #pragma GCC diagnostic pop
+
+        return false;
+    }
+
+    // an if or loop condition; comparisons are decided straight from their
+    // operands, without boxing a bool into a std::any for isTrue
+    bool condition(Expr *expr) {
+        if (profiler) return isTrue(evaluate(expr));
+
+        auto &type = typeid(*expr);
+
+        if (type == typeid(BinaryExpr)) {
+            auto binary = static_cast<BinaryExpr*>(expr);
+            if (comparison(binary->Operator.type)) {
+                HD_STAT(fastConditions);
+                std::any left = evaluate(binary->left), right = evaluate(binary->right);
+                return compare(binary->Operator, binary->operands, left, right);
+            }
+        } else if (type == typeid(VarLiteralExpr)) {
+            auto fused = static_cast<VarLiteralExpr*>(expr);
+            if (comparison(fused->Operator.type)) {
+                HD_STAT(fastConditions);
+                const std::any &value = variable(fused->name, fused->slot, fused->cache);
+                if (fused->literalFirst) return compare(fused->Operator, fused->operands, fused->constant, value);
+                return compare(fused->Operator, fused->operands, value, fused->constant);
+            }
+        } else if (type == typeid(VarVarExpr)) {
+            auto fused = static_cast<VarVarExpr*>(expr);
+            if (comparison(fused->Operator.type)) {
+                HD_STAT(fastConditions);
+                const std::any &left = variable(fused->left, fused->leftSlot, fused->leftCache);
+                const std::any &right = variable(fused->right, fused->rightSlot, fused->rightCache);
+                return compare(fused->Operator, fused->operands, left, right);
+            }
+        }
+
+        return isTrue(evaluate(expr));
+    }
+
     bool isTrue(std::any expr) {
+        HD_STAT(anyCopies);
         if (!expr.has_value()) return false;
 
-        if (expr.type() == typeid(bool)) return std::any_cast<bool>(expr);
+        if (expr.type() == typeid(bool)) return cast<bool>(expr);
         
         return false;
     }
 
     bool isEqual(std::any left, std::any right) {
+        HD_STAT_ADD(anyCopies, 2);
         if (!left.has_value() && !right.has_value()) return true;
 
         if (!left.has_value()) return false;
 
+        // integers and doubles compare by value, 3 == 3.0
+        double x, y;
+        if (number::get(left, x) && number::get(right, y)) return x == y;
+
         if (left.type() != right.type()) return false;
 
-        if (left.type() == typeid(double)) return std::any_cast<double>(left) == std::any_cast<double>(right);
+        if (left.type() == typeid(bool)) return cast<bool>(left) == cast<bool>(right);
+
+        if (left.type() == typeid(std::string)) return cast<std::string>(left) == cast<std::string>(right);
+
+        if (left.type() == typeid(LoxFunction)) return cast<LoxFunction>(left) == cast<LoxFunction>(right);
+
+        if (left.type() == typeid(LoxNative)) return cast<LoxNative>(left) == cast<LoxNative>(right);
+
+        if (left.type() == typeid(Ref<LoxArray>)) return cast<Ref<LoxArray>>(left) == cast<Ref<LoxArray>>(right);
 
-        if (left.type() == typeid(bool)) return std::any_cast<bool>(left) == std::any_cast<bool>(right);
+        if (left.type() == typeid(Ref<LoxMap>)) return cast<Ref<LoxMap>>(left) == cast<Ref<LoxMap>>(right);
 
-        if (left.type() == typeid(std::string)) return std::any_cast<std::string>(left) == std::any_cast<std::string>(right);
+        if (left.type() == typeid(Ref<LoxTask>)) return cast<Ref<LoxTask>>(left) == cast<Ref<LoxTask>>(right);
+
+        if (left.type() == typeid(LoxClass*)) return cast<LoxClass*>(left) == cast<LoxClass*>(right);
+
+        if (left.type() == typeid(Ref<LoxInstance>)) return cast<Ref<LoxInstance>>(left) == cast<Ref<LoxInstance>>(right);
+
+        if (left.type() == typeid(Ref<LoxBoundMethod>)) return cast<Ref<LoxBoundMethod>>(left) == cast<Ref<LoxBoundMethod>>(right);
         
         return false;
     }
 
-    void checkNumberOperand(Token Operator, std::any operand) {
-        if (operand.type() == typeid(double)) return;
+    double numberOperand(Mark Operator, const std::any& operand) {
+        double value;
+        if (number::get(operand, value)) return value;
 
         throw RuntimeError (Operator, "Operand must be a number");
     }
 
-    void checkNumberOperands(Token Operator, std::any left, std::any right) {
-        if (left.type() == typeid(double) && right.type() == typeid(double)) return;
+    std::pair<double, double> numberOperands(Mark Operator, const std::any& left, const std::any& right) {
+        double x, y;
+        if (number::get(left, x) && number::get(right, y)) return { x, y };
 
         throw RuntimeError(Operator, "Operands must be a numbers");
     }
 
     std::string stringify(std::any object) {
+        HD_STAT(anyCopies);
         if (!object.has_value() || object.type() == typeid(nullptr_t)) return "nil";
+
+        if (object.type() == typeid(LoxFunction)) return "<fn " + cast<LoxFunction>(object).declaration->name.lexeme + ">";
+
+        if (object.type() == typeid(LoxNative)) return "<native fn " + cast<LoxNative>(object).def->name + ">";
+
+        if (object.type() == typeid(Ref<LoxArray>)) {
+            LoxArray *array = cast<Ref<LoxArray>>(object).get();
+            std::string result = "[";
+
+            for (size_t i = 0; i < array->size(); i++) {
+                if (i) result += ", ";
+                result += stringify(array->get(i));
+            }
+
+            return result + "]";
+        }
+
+        if (object.type() == typeid(Ref<LoxMap>)) {
+            std::string result = "{";
+
+            for (auto &entry : cast<Ref<LoxMap>>(object)->entries) {
+                if (entry.distance < 0) continue;
+                if (result.size() > 1) result += ", ";
+                result += stringify(map::keyValue(entry.key)) + ": " + stringify(entry.value);
+            }
+
+            return result + "}";
+        }
+
+        if (object.type() == typeid(Ref<LoxTask>)) return "<task>";
+
+        if (object.type() == typeid(LoxClass*)) return cast<LoxClass*>(object)->name;
+
+        if (object.type() == typeid(Ref<LoxInstance>)) return cast<Ref<LoxInstance>>(object)->klass->name + " instance";
+
+        if (object.type() == typeid(Ref<LoxBoundMethod>)) return "<fn " + cast<Ref<LoxBoundMethod>>(object)->method.function->name.lexeme + ">";
  
-        if (object.type() == typeid(double)) return std::to_string(std::any_cast<double>(object));
+        double value;
+        if (number::get(object, value)) return std::to_string(value);
 
-        if (object.type() == typeid(bool)) return std::any_cast<bool>(object) ? "true" : "false";
+        if (object.type() == typeid(bool)) return cast<bool>(object) ? "true" : "false";
 
-        return std::any_cast<std::string>(object);
+        return cast<std::string>(object);
     }
 public:
+    // attached by hd --profile, null otherwise
+    Profiler *profiler = nullptr;
+
+    // deepest nesting of non tail calls before a RuntimeError is raised
+    size_t maxCallDepth = 1000;
+
+    // whether bodies parsed on their first call go through the Fuser
+    bool fuse = true;
+
+    // statements a run may execute, 0 for no limit; every task gets a budget of its own
+    uint64_t maxFuel = 0;
+
+    // live heap bytes of the whole process past which a run stops, 0 for no cap.
+    // Checked once per batch of fuel, so a run can overshoot by what one batch allocates
+    size_t maxHeap = 0;
+
+    Interpreter() : environment(prelude()) {}
+
+    // the natives of the standard modules, built on first use and then shared
+    // read-only by every interpreter in the process
+    static std::shared_ptr<const Environment::Values> prelude() {
+        static const auto shared = [] {
+            auto values = std::make_shared<Environment::Values>();
+            for (auto list : { &builtins::natives(), &array::natives(), &map::natives() }) {
+                for (auto &native : *list) values->insert_or_assign(native.name, LoxNative{ &native });
+            }
+            return std::shared_ptr<const Environment::Values>(std::move(values));
+        }();
+
+        return shared;
+    }
+
+    // whether a global of that name exists before any script has run in here
+    bool defines(const std::string& name) const {
+        return environment.has(name);
+    }
+
+    // natives in a list that outlives the interpreter, such as the static ones of each module
+    void defineNatives(const std::vector<NativeDef>& natives) {
+        for (auto &native : natives) environment.define(native.name, LoxNative{ &native });
+    }
+
+    // makes a C++ function callable from scripts under the given name, e.g.
+    // defineNative<hypot>("hypot") for double hypot(double, double)
+    template <auto F>
+    void defineNative(const std::string& name) {
+        hostNatives.push_back(native<F>(name));
+        environment.define(name, LoxNative{ &hostNatives.back() });
+    }
+
     /* Expression implementations */
 
     std::any visitLiteralExpr(LiteralExpr *expr) override {
+        HD_STAT(anyCopies);
         return expr->value;
     }
 
@@ -84,8 +800,12 @@ public:
             return !isTrue(right);
 
         case TokenType::MINUS:
-            checkNumberOperand(expr->Operator, right);
-            return - std::any_cast<double>(right);
+            if (auto integer = std::any_cast<int64_t>(&right)) return number::negate(*integer);
+            if (expr->operands == Operands::Numbers) {
+                HD_STAT(uncheckedOps);
+                return - *std::any_cast<double>(&right);
+            }
+            return - numberOperand(expr->Operator, right);
         
         default:
             break;
@@ -94,31 +814,82 @@ public:
         return nullptr;
     }
 
-    std::any visitBinaryExpr(BinaryExpr* expr) override {
-        std::any left = evaluate(expr->left),
-                 right = evaluate(expr->right);
-
+    // the operator itself, shared by BinaryExpr and the fused nodes
+    std::any binary(Mark Operator, Operands operands, const std::any& left, const std::any& right) {
         #pragma GCC diagnostic push
         #pragma GCC diagnostic ignored "-Wswitch"
 
-        switch (expr->Operator.type) {
+        // two integers stay on int64, see number.hpp for when they turn into doubles
+        auto a = std::any_cast<int64_t>(&left), b = std::any_cast<int64_t>(&right);
+        if (a && b) {
+            HD_STAT(integerOps);
+
+            switch (Operator.type) {
+                case TokenType::GREATER:       return *a > *b;
+                case TokenType::GREATER_EQUAL: return *a >= *b;
+                case TokenType::LESS:          return *a < *b;
+                case TokenType::LESS_EQUAL:    return *a <= *b;
+                case TokenType::BANG_EQUAL:    return *a != *b;
+                case TokenType::EQUAL_EQUAL:   return *a == *b;
+                case TokenType::MINUS:         return number::subtract(*a, *b);
+                case TokenType::PLUS:          return number::add(*a, *b);
+                case TokenType::STAR:          return number::multiply(*a, *b);
+                case TokenType::SLASH:         return static_cast<double>(*a) / static_cast<double>(*b);
+            }
+        }
+
+        // the TypeChecker proved these operand types, so the checks below can't fail here
+        if (operands == Operands::Numbers) {
+            HD_STAT(uncheckedOps);
+            double x = number::unchecked(left), y = number::unchecked(right);
+
+            switch (Operator.type) {
+                case TokenType::GREATER:       return x > y;
+                case TokenType::GREATER_EQUAL: return x >= y;
+                case TokenType::LESS:          return x < y;
+                case TokenType::LESS_EQUAL:    return x <= y;
+                case TokenType::BANG_EQUAL:    return x != y;
+                case TokenType::EQUAL_EQUAL:   return x == y;
+                case TokenType::MINUS:         return x - y;
+                case TokenType::PLUS:          return x + y;
+                case TokenType::STAR:          return x * y;
+                case TokenType::SLASH:         return x / y;
+            }
+        }
+
+        if (operands == Operands::Strings) {
+            HD_STAT(uncheckedOps);
+            auto &x = *std::any_cast<std::string>(&left), &y = *std::any_cast<std::string>(&right);
+
+            switch (Operator.type) {
+                case TokenType::BANG_EQUAL:    return x != y;
+                case TokenType::EQUAL_EQUAL:   return x == y;
+                case TokenType::PLUS:          return x + y;
+            }
+        }
+
+        switch (Operator.type) {
             // comparison operators
 
-            case TokenType::GREATER:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) > std::any_cast<double>(right);
+            case TokenType::GREATER: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x > y;
+            }
 
-            case TokenType::GREATER_EQUAL:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) >= std::any_cast<double>(right);
+            case TokenType::GREATER_EQUAL: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x >= y;
+            }
 
-            case TokenType::LESS:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) < std::any_cast<double>(right);
+            case TokenType::LESS: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x < y;
+            }
 
-            case TokenType::LESS_EQUAL:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) <= std::any_cast<double>(right);
+            case TokenType::LESS_EQUAL: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x <= y;
+            }
 
             case TokenType::BANG_EQUAL: return !isEqual(left, right);
 
@@ -126,40 +897,328 @@ public:
 
             // arithmetic operators
 
-            case TokenType::MINUS:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) - std::any_cast<double>(right);
-            
-            case TokenType::SLASH:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) / std::any_cast<double>(right);
+            case TokenType::MINUS: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x - y;
+            }
 
-            case TokenType::STAR:
-                checkNumberOperands(expr->Operator, left, right);
-                return std::any_cast<double>(left) * std::any_cast<double>(right);
+            case TokenType::SLASH: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x / y;
+            }
+
+            case TokenType::STAR: {
+                auto [x, y] = numberOperands(Operator, left, right);
+                return x * y;
+            }
+
+            case TokenType::PLUS: {
+                double x, y;
+                if (number::get(left, x) && number::get(right, y)) return x + y;
 
-            case TokenType::PLUS:
-                if (left.type() == typeid(double) && right.type() == typeid(double) ) {
-                    return std::any_cast<double>(left) + std::any_cast<double>(right);
-                }
                 if (left.type() == typeid(std::string) && right.type() == typeid(std::string)) {
-                    return std::any_cast<std::string>(left) + std::any_cast<std::string>(right);
+                    return cast<std::string>(left) + cast<std::string>(right);
                 }
 
-                throw RuntimeError(expr->Operator, "Operands must be two strings or numbers");
+                throw RuntimeError(Operator, "Operands must be two strings or numbers");
+            }
         }
         #pragma GCC diagnostic pop
 
         return nullptr;
     }
 
-    std::any visitAssignExpr(AssignExpr *expr) {
+    std::any visitBinaryExpr(BinaryExpr* expr) override {
+        std::any left = evaluate(expr->left),
+                 right = evaluate(expr->right);
+
+        return binary(expr->Operator, expr->operands, left, right);
+    }
+
+    // a global, from the running loop's cache when the site has an entry there
+    const std::any& global(const Token& name, int cache) {
+        if (cache < 0) return environment.find(name);
+
+        CachedGlobal &entry = globalCache[cacheBase + cache];
+        if (!entry.value || entry.version != environment.version()) {
+            entry = CachedGlobal{ &environment.find(name), nullptr, environment.version() };
+        } else {
+            HD_STAT(cachedGlobals);
+        }
+
+        return *entry.value;
+    }
+
+    // a global to write in place, see global()
+    std::any& globalTarget(const Token& name, int cache) {
+        if (cache < 0) return environment.target(name);
+
+        CachedGlobal &entry = globalCache[cacheBase + cache];
+        if (!entry.target || entry.version != environment.version()) {
+            // a prelude variable is copied out here, which moves the version on
+            std::any &target = environment.target(name);
+            entry = CachedGlobal{ &target, &target, environment.version() };
+        } else {
+            HD_STAT(cachedGlobals);
+        }
+
+        return *entry.target;
+    }
+
+    // a local's frame slot or a global, found with at most one lookup
+    const std::any& variable(const Token& name, int slot, int cache) {
+        if (slot >= 0) return stack[fp + slot];
+        return global(name, cache);
+    }
+
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override {
+        std::any &target = expr->slot >= 0 ? stack[fp + expr->slot] : globalTarget(expr->name, expr->cache);
+        target = binary(expr->Operator, expr->operands, target, expr->constant);
+        return target;
+    }
+
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override {
+        const std::any &value = variable(expr->name, expr->slot, expr->cache);
+
+        if (expr->literalFirst) return binary(expr->Operator, expr->operands, expr->constant, value);
+        return binary(expr->Operator, expr->operands, value, expr->constant);
+    }
+
+    std::any visitVarVarExpr(VarVarExpr *expr) override {
+        const std::any &left = variable(expr->left, expr->leftSlot, expr->leftCache);
+        const std::any &right = variable(expr->right, expr->rightSlot, expr->rightCache);
+
+        return binary(expr->Operator, expr->operands, left, right);
+    }
+
+    std::any visitAssignExpr(AssignExpr *expr) override {
         std::any value = evaluate(expr->value);
 
-        environment.assign(expr->name, value);
+        if (expr->slot >= 0) stack[fp + expr->slot] = value;
+        else if (expr->cache >= 0) globalTarget(expr->name, expr->cache) = value;
+        else environment.assign(expr->name, value);
+
         return value;
     }
 
+    std::any visitCallExpr(CallExpr *expr) override {
+        if (GetExpr *get = expr->property) {
+            std::any object = evaluate(get->object);
+            Ref<LoxInstance> *instance = asInstance(object);
+            if (!instance) throw RuntimeError(get->name, "Only instances have properties.");
+
+            InlineCache::Entry found = property(instance->get(), get->cache, get->name);
+            if (found.method) return invoke(*instance, Method{ found.method, found.owner }, expr);
+
+            std::any callee = (*instance)->fields[found.slot];
+            return call(callee, expr);
+        }
+
+        if (SuperExpr *super = expr->superMethod) {
+            Method method = superMethod(super);
+            return invoke(cast<Ref<LoxInstance>>(stack[fp + super->slot]), method, expr);
+        }
+
+        return call(evaluate(expr->callee), expr);
+    }
+
+    std::any visitGetExpr(GetExpr *expr) override {
+        std::any object = evaluate(expr->object);
+        Ref<LoxInstance> *instance = asInstance(object);
+        if (!instance) throw RuntimeError(expr->name, "Only instances have properties.");
+
+        InlineCache::Entry found = property(instance->get(), expr->cache, expr->name);
+        if (found.method) return make<LoxBoundMethod>(*instance, Method{ found.method, found.owner });
+
+        return (*instance)->fields[found.slot];
+    }
+
+    std::any visitSetExpr(SetExpr *expr) override {
+        std::any object = evaluate(expr->object);
+        Ref<LoxInstance> *instance = asInstance(object);
+        if (!instance) throw RuntimeError(expr->name, "Only instances have fields.");
+
+        std::any value = evaluate(expr->value);
+        LoxInstance *target = instance->get();
+
+        if (auto hit = expr->cache.find(target->shape)) {
+            HD_STAT(inlineCacheHits);
+            if (hit->transition) target->addField(hit->transition, value);
+            else target->fields[hit->slot] = value;
+            return value;
+        }
+
+        HD_STAT(inlineCacheMisses);
+        int slot = target->shape->find(expr->name.lexeme);
+
+        if (slot >= 0) {
+            expr->cache.add({ target->shape, slot, nullptr, nullptr, nullptr });
+            target->fields[slot] = value;
+        } else {
+            Shape *next = target->shape->with(expr->name.lexeme);
+            expr->cache.add({ target->shape, -1, nullptr, nullptr, next });
+            target->addField(next, value);
+        }
+
+        return value;
+    }
+
+    std::any visitThisExpr(ThisExpr *expr) override {
+        return stack[fp + expr->slot];
+    }
+
+    std::any visitSuperExpr(SuperExpr *expr) override {
+        Method method = superMethod(expr);
+        return make<LoxBoundMethod>(cast<Ref<LoxInstance>>(stack[fp + expr->slot]), method);
+    }
+
+    std::any visitArrayExpr(ArrayExpr *expr) override {
+        auto array = make<LoxArray>();
+        array->numbers.reserve(expr->elements.size());
+
+        for (auto element : expr->elements) array->push(evaluate(element));
+        return array;
+    }
+
+    std::any visitIndexExpr(IndexExpr *expr) override {
+        std::any object = evaluate(expr->object);
+
+        if (Ref<LoxArray> *array = asArray(object)) {
+            size_t i = index(evaluate(expr->index), array->get(), expr->bracket);
+            return (*array)->get(i);
+        }
+
+        LoxMap *map = asMap(object, expr->bracket);
+
+        // missing keys read as nil
+        std::any index;
+        LoxMap::Entry *entry = map->find(mapKey(expr->key, expr->index, expr->bracket, index));
+        return entry ? entry->value : std::any();
+    }
+
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override {
+        std::any object = evaluate(expr->object);
+
+        if (Ref<LoxArray> *array = asArray(object)) {
+            std::any position = evaluate(expr->index);
+            std::any value = evaluate(expr->value);
+
+            (*array)->set(index(position, array->get(), expr->bracket), value);
+            return value;
+        }
+
+        LoxMap *map = asMap(object, expr->bracket);
+        std::any index;
+        MapKey key = mapKey(expr->key, expr->index, expr->bracket, index);
+        std::any value = evaluate(expr->value);
+
+        map->set(key, value);
+        return value;
+    }
+
+    std::any visitSpawnExpr(SpawnExpr *expr) override {
+        CallExpr *call = expr->call;
+        std::any callee = evaluate(call->callee);
+        if (callee.type() != typeid(LoxFunction)) throw RuntimeError(expr->keyword, "Can only spawn functions.");
+
+        FunStmt *function = cast<LoxFunction>(callee).declaration;
+
+        Copies copies;
+        std::vector<FunStmt*> reachable = { function };
+        auto args = std::make_shared<std::vector<std::any>>();
+
+        for (auto argument : call->arguments) {
+            args->emplace_back();
+            if (!send(evaluate(argument), args->back(), copies, reachable)) {
+                throw RuntimeError(expr->keyword, "Only nil, booleans, numbers, strings, functions, arrays and maps can be passed to a task.");
+            }
+        }
+
+        checkArity(function, args->size(), call->paren);
+
+        // the task sees the globals it can reach as they are now, minus the ones
+        // that can't be copied, and shares the prelude instead of copying it
+        auto globals = std::make_shared<Environment>(environment.layer());
+        std::unordered_set<FunStmt*> visited;
+        std::unordered_set<std::string> sent;
+
+        auto reach = [&](const std::string& name) {
+            if (!sent.insert(name).second) return;
+
+            std::any copy;
+            auto value = environment.own(name);
+            if (value && send(*value, copy, copies, reachable)) globals->define(name, std::move(copy));
+        };
+
+        while (!reachable.empty()) {
+            FunStmt *next = reachable.back();
+            reachable.pop_back();
+            if (!visited.insert(next).second) continue;
+
+            // a body still unparsed, or being parsed by a task right now, is read from its tokens
+            if (next->lazy) {
+                next->lazy->identifiers(reach);
+            } else {
+                for (auto &name : next->globals) reach(name);
+            }
+        }
+
+        // the copies belong to the task from here on, this thread must not hold on to them
+        copies.clear();
+
+        if (!pool) {
+            ownedPool = std::make_unique<TaskPool>(TaskPool::defaultWorkers());
+            pool = ownedPool.get();
+        }
+
+        HD_STAT(tasksSpawned);
+        auto state = std::make_shared<TaskState>();
+
+        // forget tasks that were awaited already, so spawning in a loop does not pile them up
+        if (spawned.size() >= 64) {
+            spawned.erase(std::remove_if(spawned.begin(), spawned.end(), [](auto &task) { return task->awaited; }),
+                          spawned.end());
+        }
+        spawned.push_back(state);
+
+        pool->submit([pool = pool, state, globals, args, function, paren = call->paren, depth = maxCallDepth,
+                      fuse = fuse, fuel = maxFuel, heap = maxHeap]() mutable {
+            int phase = Stats::phase;
+            Stats::phase = static_cast<int>(Phase::Interpret);
+
+            {
+                Interpreter task(pool, std::move(*globals), state->output);
+                task.maxCallDepth = depth;
+                task.fuse = fuse;
+                task.maxFuel = fuel;
+                task.maxHeap = heap;
+
+                try {
+                    state->result = task.runTask(function, *args, paren);
+                } catch (RuntimeError &e) {
+                    state->error = e;
+                }
+            }
+
+            // nothing the task made may stay behind on this thread once it is done
+            globals.reset();
+            args.reset();
+
+            Stats::phase = phase;
+            Stats::flushThread();
+            state->finish();
+        });
+
+        return make<LoxTask>(state);
+    }
+
+    std::any visitAwaitExpr(AwaitExpr *expr) override {
+        std::any value = evaluate(expr->task);
+        if (value.type() != typeid(Ref<LoxTask>)) throw RuntimeError(expr->keyword, "Can only await tasks.");
+
+        return await(*cast<Ref<LoxTask>>(value)->state);
+    }
+
     /*Statement implementations*/
     void visitExpressionStmt(ExpressionStmt *stmt) override {
         evaluate(stmt->expression);
@@ -167,7 +1226,7 @@ public:
 
     void visitPrintStmt(PrintStmt *stmt) override {
         std::any value = evaluate(stmt->expression);
-        std::cout << stringify(value) << "\n";
+        *out << stringify(value) << "\n";
     }
 
     void visitVarStmt(VarStmt *stmt) override {
@@ -176,22 +1235,147 @@ public:
         if (stmt->initializer != nullptr) 
             value = evaluate(stmt->initializer);
 
-        environment.define(stmt->name.lexeme, value);
+        if (stmt->slot >= 0) stack[fp + stmt->slot] = value;
+        else environment.define(stmt->name.lexeme, value);
+    }
+
+    void visitBlockStmt(BlockStmt *stmt) override {
+        size_t enclosingSp = sp;
+        size_t start = fp + stmt->slotStart, end = start + stmt->slotCount;
+
+        sp = std::max(sp, end);
+        reserve(sp);
+
+        execute(stmt->statements);
+
+        clearSlots(start, end);
+        sp = enclosingSp;
+    }
+
+    void visitFunStmt(FunStmt *stmt) override {
+        LoxFunction function{ stmt };
+
+        if (stmt->slot >= 0) stack[fp + stmt->slot] = function;
+        else environment.define(stmt->name.lexeme, function);
+    }
+
+    void visitReturnStmt(ReturnStmt *stmt) override {
+        if (stmt->tailCall) {
+            auto tail = static_cast<CallExpr*>(stmt->value);
+            std::any callee = evaluate(tail->callee);
+
+            if (callee.type() == typeid(LoxFunction)) {
+                FunStmt *function = cast<LoxFunction>(callee).declaration;
+                size_t base = pushArguments(tail->arguments);
+                checkArity(function, sp - base, tail->paren);
+
+                // the arguments stay above the frame until call() moves them down
+                tailCallee = function;
+                tailBase = base;
+                tailArgs = sp - base;
+                sp = base;
+                returning = true;
+                return;
+            }
+
+            returnValue = call(callee, tail);
+            returning = true;
+            return;
+        }
+
+        returnValue = stmt->value ? evaluate(stmt->value) : std::any();
+        returning = true;
+    }
+
+    void visitClassStmt(ClassStmt *stmt) override {
+        // its instances would fill the inline caches of the shared AST, which tasks only read
+        if (inTask) throw RuntimeError(stmt->name, "Can't declare a class inside a task.");
+
+        LoxClass *superclass = nullptr;
+
+        if (stmt->superclass) {
+            std::any value = evaluate(stmt->superclass);
+            if (value.type() != typeid(LoxClass*)) throw RuntimeError(stmt->superclass->name, "Superclass must be a class.");
+            superclass = cast<LoxClass*>(value);
+        }
+
+        classes.push_back(std::make_unique<LoxClass>(stmt->name.lexeme, superclass));
+        LoxClass *klass = classes.back().get();
+
+        for (auto method : stmt->methods) klass->methods[method->name.lexeme] = Method{ method, klass };
+        klass->initializer = klass->findMethod("init");
+
+        if (stmt->slot >= 0) stack[fp + stmt->slot] = klass;
+        else environment.define(stmt->name.lexeme, klass);
+    }
+
+    void visitIfStmt(IfStmt *stmt) override {
+        if (condition(stmt->condition)) evaluate(stmt->thenBranch);
+        else if (stmt->elseBranch) evaluate(stmt->elseBranch);
+    }
+
+    void visitWhileStmt(WhileStmt *stmt) override {
+        // the loop's cache goes above those of the loops it runs inside of
+        size_t enclosingBase = cacheBase;
+        cacheBase = cacheTop;
+        cacheTop += stmt->globals;
+        if (globalCache.size() < cacheTop) globalCache.resize(std::max(cacheTop, globalCache.size() * 2));
+        std::fill(globalCache.begin() + cacheBase, globalCache.begin() + cacheTop, CachedGlobal{});
+
+        // a trip burns the body's fuel in the loop's name, an empty body has no line to report
+        while (condition(stmt->condition)) {
+            if (--tick < 0) checkpoint(stmt);
+            execute(stmt->body);
+            if (returning) break;
+
+            if (stmt->increment) evaluate(stmt->increment);
+        }
+
+        cacheTop = cacheBase;
+        cacheBase = enclosingBase;
     }
 
     std::any visitVariableExpr(VariableExpr *expr) override {
+        if (expr->slot >= 0) return stack[fp + expr->slot];
+        if (expr->cache >= 0) return global(expr->name, expr->cache);
+
         return environment.get(expr->name);
     }
 
     void interpret(std::vector<Stmt*> statments) {
+        size_t i = 0;
+        interpret([&]() -> Stmt* { return i < statments.size() ? statments[i++] : nullptr; });
+    }
+
+    // runs statements as next() hands them over, until it returns null
+    template <typename Next>
+    void interpret(Next next) {
         try {
 
-            for (auto stmt : statments) {
+            while (Stmt *stmt = next()) {
                 evaluate(stmt);
             }
             
         } catch (RuntimeError &e) {
             Errors::runtimeError(e);
+
+            // unwind whatever frames the error left behind
+            clearSlots(0, stack.size());
+            fp = sp = callDepth = 0;
+            methodClass = nullptr;
+            cacheBase = cacheTop = 0;
+            returning = false;
+            tailCallee = nullptr;
+        }
+
+        if (spawned.empty()) return;
+
+        try {
+            finishTasks();
+        } catch (RuntimeError &e) {
+            Errors::runtimeError(e);
+            // the rest still get their output flushed and errors reported
+            interpret({});
         }
     }
 };
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <any>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "array.hpp"
+#include "native.hpp"
+#include "number.hpp"
+#include "object.hpp"
+#include "runtime_error.hpp"
+#include "stats.hpp"
+#include "symbol.hpp"
+
+/*
+  A map key: a string or a number, which is a number when text is null.
+  Keys stored in a map always hold an interned Symbol. A key made to look
+  something up may hold only the text, pointing at a string that has to
+  outlive it, and is compared by its text; the map interns it only if it
+  stores it.
+*/
+struct MapKey {
+    const Symbol *symbol = nullptr;
+    const std::string *text = nullptr;
+    double number = 0;
+    uint32_t hash = 0;
+
+    bool operator==(const MapKey& other) const {
+        if (hash != other.hash) return false;
+        if (!text || !other.text) return !text && !other.text && number == other.number;
+        // a text has one symbol, so two different symbols are different texts
+        if (symbol && other.symbol) return symbol == other.symbol;
+        return *text == *other.text;
+    }
+
+    static MapKey of(const Symbol *symbol) {
+        return MapKey{ symbol, &symbol->text, 0, symbol->hash };
+    }
+
+    static MapKey of(const std::string *text) {
+        return MapKey{ nullptr, text, 0, Symbols::hash(*text) };
+    }
+
+    static MapKey of(double number) {
+        if (number == 0) number = 0; // -0 and 0 are the same key
+
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+
+        // splitmix64 finalizer, so keys 0, 1, 2... do not all land in neighbouring slots
+        bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        bits = (bits ^ (bits >> 27)) * 0x94d049bb133111ebULL;
+        bits ^= bits >> 31;
+
+        return MapKey{ nullptr, nullptr, number, static_cast<uint32_t>(bits) };
+    }
+};
+
+/*
+  Open addressing table with Robin Hood probing. Entries live in one flat
+  array, each remembering how far it sits from its home slot. An insert
+  takes the slot of any entry that is closer to home than itself, which
+  keeps probe sequences short and lets a lookup stop as soon as it passes
+  an entry closer to home than the key would be. Removal shifts the
+  following entries back instead of leaving tombstones.
+*/
+class LoxMap : public Object {
+public:
+    struct Entry {
+        MapKey key;
+        // from the home slot, -1 when the slot is empty
+        int32_t distance = -1;
+        std::any value;
+    };
+
+    std::vector<Entry> entries;
+    size_t count = 0;
+
+    LoxMap() = default;
+    LoxMap(const LoxMap&) = delete;
+    LoxMap& operator=(const LoxMap&) = delete;
+
+    ~LoxMap() {
+        for (auto &entry : entries) {
+            if (entry.distance >= 0 && entry.key.symbol) Symbols::release(entry.key.symbol);
+        }
+    }
+
+    // the key as a map stores it, holding a reference to its symbol
+    static MapKey keep(const MapKey& key) {
+        if (key.symbol) Symbols::retain(key.symbol);
+        else if (key.text) return MapKey::of(Symbols::intern(*key.text));
+        return key;
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 8;
+
+    size_t home(const MapKey& key) const {
+        return key.hash & (entries.size() - 1);
+    }
+
+    void grow() {
+        std::vector<Entry> old = std::move(entries);
+        entries = std::vector<Entry>(old.empty() ? MIN_CAPACITY : old.size() * 2);
+        count = 0;
+
+        HD_STAT(mapGrows);
+        for (auto &entry : old) {
+            if (entry.distance >= 0) place(entry.key, std::move(entry.value));
+        }
+    }
+
+    // puts a key that is known not to be in the table
+    void place(MapKey key, std::any value) {
+        Entry incoming{ key, 0, std::move(value) };
+        size_t mask = entries.size() - 1;
+
+        for (size_t i = home(key); ; i = (i + 1) & mask, incoming.distance++) {
+            Entry &entry = entries[i];
+
+            if (entry.distance < 0) {
+                entry = std::move(incoming);
+                count++;
+                return;
+            }
+
+            if (entry.distance < incoming.distance) std::swap(entry, incoming);
+        }
+    }
+
+public:
+    Entry* find(const MapKey& key) {
+        if (entries.empty()) return nullptr;
+
+        HD_STAT(mapLookups);
+        HD_STAT_ADD(mapLoadMillis, count * 1000 / entries.size());
+
+        size_t mask = entries.size() - 1;
+        int32_t distance = 0;
+
+        for (size_t i = home(key); ; i = (i + 1) & mask, distance++) {
+            Entry &entry = entries[i];
+            if (entry.distance < distance) break;
+            if (entry.key == key) {
+                recordProbe(distance + 1);
+                return &entry;
+            }
+        }
+
+        recordProbe(distance + 1);
+        return nullptr;
+    }
+
+    void set(const MapKey& key, std::any value) {
+        if (Entry *entry = find(key)) {
+            entry->value = std::move(value);
+            return;
+        }
+
+        // grow at 7/8 full, Robin Hood keeps probes short up to fairly high loads
+        if ((count + 1) * 8 > entries.size() * 7) grow();
+        place(keep(key), std::move(value));
+    }
+
+    bool remove(const MapKey& key) {
+        Entry *entry = find(key);
+        if (!entry) return false;
+        if (entry->key.symbol) Symbols::release(entry->key.symbol);
+
+        size_t mask = entries.size() - 1;
+        size_t i = entry - entries.data();
+
+        // backward shift: pull the following entries one slot closer to home
+        while (true) {
+            Entry &next = entries[(i + 1) & mask];
+            if (next.distance <= 0) break;
+
+            entries[i] = std::move(next);
+            entries[i].distance--;
+            i = (i + 1) & mask;
+        }
+
+        entries[i].distance = -1;
+        entries[i].key = MapKey();
+        entries[i].value.reset();
+        count--;
+        return true;
+    }
+
+    static void recordProbe(int32_t length) {
+        HD_STAT_ADD(mapProbes, length);
+#if HD_STATS
+        if (static_cast<uint64_t>(length) > Stats::counters.mapLongestProbe) Stats::counters.mapLongestProbe = length;
+#else
+        (void) length;
+#endif
+    }
+};
+
+template <>
+struct NativeType<LoxMap*> {
+    static LoxMap* from(const std::any& arg) {
+        if (auto map = std::any_cast<Ref<LoxMap>>(&arg)) return map->get();
+        throw NativeError("Expected a map.");
+    }
+};
+
+namespace map {
+
+// integer and double keys of the same value are the same key. A string key
+// points at the string in value, see MapKey
+inline MapKey key(const std::any &value) {
+    double number;
+    if (number::get(value, number)) {
+        if (std::isnan(number)) throw NativeError("Map key can't be NaN.");
+        return MapKey::of(number);
+    }
+
+    if (auto text = std::any_cast<std::string>(&value)) return MapKey::of(text);
+
+    throw NativeError("Map keys must be strings or numbers.");
+}
+
+inline std::any keyValue(const MapKey &key) {
+    if (key.text) return *key.text;
+    return key.number;
+}
+
+inline Ref<LoxMap> create() {
+    return make<LoxMap>();
+}
+
+inline bool has(LoxMap *map, const std::any &value) {
+    return map->find(key(value)) != nullptr;
+}
+
+inline bool remove(LoxMap *map, const std::any &value) {
+    return map->remove(key(value));
+}
+
+inline double size(LoxMap *map) {
+    return static_cast<double>(map->count);
+}
+
+// in table order, which is not insertion order
+inline Ref<LoxArray> keys(LoxMap *map) {
+    auto result = make<LoxArray>();
+
+    for (auto &entry : map->entries) {
+        if (entry.distance >= 0) result->push(keyValue(entry.key));
+    }
+
+    return result;
+}
+
+inline const std::vector<NativeDef>& natives() {
+    static const std::vector<NativeDef> defs = {
+        native<create>("map"),
+        native<has>("has"),
+        native<remove>("remove"),
+        native<size>("size"),
+        native<keys>("keys"),
+    };
+
+    return defs;
+}
+
+}
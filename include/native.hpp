@@ -0,0 +1,134 @@
+#pragma once
+
+#include <any>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "number.hpp"
+#include "runtime_error.hpp"
+#include "tokens.hpp"
+
+/*
+  Functions implemented in C++. The interpreter evaluates the arguments
+  straight onto its stack and hands the native a pointer to the first one,
+  so calling a native never builds an argument vector.
+*/
+struct NativeDef {
+    std::string name;
+    size_t arity;
+    std::any (*function)(std::any *args, Mark paren);
+
+    // set for natives that take and return only numbers, the interpreter
+    // calls those directly and never boxes their arguments on the stack
+    double (*unary)(double) = nullptr;
+    double (*binary)(double, double) = nullptr;
+};
+
+// natives are registered once and never freed, so the value is just a pointer
+struct LoxNative {
+    const NativeDef *def;
+
+    bool operator==(const LoxNative& other) const {
+        return def == other.def;
+    }
+};
+
+// thrown by natives, the interpreter reports it at the call's closing paren
+class NativeError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/*
+  How a C++ type crosses into and out of a typed native. Parameters are
+  unboxed with from(), which throws a NativeError naming the expected type;
+  results are boxed with to(). Headers that add runtime types specialize
+  this for their parameter types.
+*/
+template <typename T>
+struct NativeType {
+    static std::any to(T value) { return value; }
+};
+
+template <>
+struct NativeType<double> {
+    static double from(const std::any& arg) {
+        double value;
+        if (number::get(arg, value)) return value;
+        throw NativeError("Expected a number.");
+    }
+
+    static std::any to(double value) { return value; }
+};
+
+template <>
+struct NativeType<bool> {
+    static bool from(const std::any& arg) {
+        if (auto value = std::any_cast<bool>(&arg)) return *value;
+        throw NativeError("Expected a boolean.");
+    }
+
+    static std::any to(bool value) { return value; }
+};
+
+template <>
+struct NativeType<std::string> {
+    static const std::string& from(const std::any& arg) {
+        if (auto value = std::any_cast<std::string>(&arg)) return *value;
+        throw NativeError("Expected a string.");
+    }
+
+    static std::any to(std::string value) { return value; }
+};
+
+// any value at all, left to the native to look at
+template <>
+struct NativeType<std::any> {
+    static const std::any& from(const std::any& arg) { return arg; }
+    static std::any to(std::any value) { return value; }
+};
+
+template <auto F>
+struct NativeCall;
+
+template <typename R, typename... Args, R (*F)(Args...)>
+struct NativeCall<F> {
+    static constexpr size_t arity = sizeof...(Args);
+
+    template <size_t... I>
+    static std::any unpack(std::any *args, std::index_sequence<I...>) {
+        // braced so the arguments are checked left to right
+        std::tuple<decltype(NativeType<std::decay_t<Args>>::from(args[I]))...> values{
+            NativeType<std::decay_t<Args>>::from(args[I])...
+        };
+
+        if constexpr (std::is_void_v<R>) {
+            std::apply(F, values);
+            return std::any();
+        } else {
+            return NativeType<std::decay_t<R>>::to(std::apply(F, values));
+        }
+    }
+
+    static std::any call(std::any *args, Mark paren) {
+        try {
+            return unpack(args, std::index_sequence_for<Args...>());
+        } catch (NativeError &e) {
+            throw RuntimeError(paren, e.what());
+        }
+    }
+};
+
+// describes a plain C++ function as a native, its arity and types come from the signature
+template <auto F>
+NativeDef native(const std::string& name) {
+    NativeDef def{ name, NativeCall<F>::arity, NativeCall<F>::call };
+
+    if constexpr (std::is_same_v<decltype(F), double (*)(double)>) def.unary = F;
+    if constexpr (std::is_same_v<decltype(F), double (*)(double, double)>) def.binary = F;
+
+    return def;
+}
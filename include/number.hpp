@@ -0,0 +1,96 @@
+#pragma once
+
+#include <any>
+#include <cmath>
+#include <cstdint>
+
+#include "stats.hpp"
+
+/*
+  Lox numbers are doubles, but integral values are carried as int64_t while
+  they stay within +-2^53, the range in which a double holds every integer
+  exactly. Inside that range integer add, subtract and multiply give the
+  same value a double would, so they run on int64 registers. A result that
+  leaves the range is recomputed in double, with the same rounding a pure
+  double program would see. Division always gives a double.
+
+  The only other difference doubles can observe is -0: integers have no
+  negative zero, so every operation that would produce one as a double
+  (negating 0, multiplying 0 by a negative) returns the double -0 instead.
+  Printing, equality and map keys treat 3 and 3.0 as the same number.
+*/
+namespace number {
+
+constexpr int64_t EXACT = int64_t(1) << 53;
+
+inline bool exact(int64_t value) {
+    return value >= -EXACT && value <= EXACT;
+}
+
+// reads any kind of number as a double, false for everything else
+inline bool get(const std::any& value, double& out) {
+    if (auto integer = std::any_cast<int64_t>(&value)) {
+        out = static_cast<double>(*integer);
+        return true;
+    }
+
+    if (auto real = std::any_cast<double>(&value)) {
+        out = *real;
+        return true;
+    }
+
+    return false;
+}
+
+// for values already known to be numbers
+inline double unchecked(const std::any& value) {
+    if (auto integer = std::any_cast<int64_t>(&value)) return static_cast<double>(*integer);
+    return *std::any_cast<double>(&value);
+}
+
+inline bool is(const std::any& value) {
+    return std::any_cast<int64_t>(&value) || std::any_cast<double>(&value);
+}
+
+// the literal's value, as an integer when it is one
+inline std::any literal(double value) {
+    if (value == std::floor(value) && std::fabs(value) <= static_cast<double>(EXACT)) {
+        return static_cast<int64_t>(value);
+    }
+    return value;
+}
+
+inline std::any add(int64_t a, int64_t b) {
+    // both are within 2^53, so the sum can't overflow int64
+    int64_t sum = a + b;
+    if (exact(sum)) return sum;
+
+    HD_STAT(integerPromotions);
+    return static_cast<double>(a) + static_cast<double>(b);
+}
+
+inline std::any subtract(int64_t a, int64_t b) {
+    int64_t difference = a - b;
+    if (exact(difference)) return difference;
+
+    HD_STAT(integerPromotions);
+    return static_cast<double>(a) - static_cast<double>(b);
+}
+
+inline std::any multiply(int64_t a, int64_t b) {
+    int64_t product;
+    if (!__builtin_mul_overflow(a, b, &product) && exact(product)) {
+        if (product == 0 && (a < 0 || b < 0)) return -0.0;
+        return product;
+    }
+
+    HD_STAT(integerPromotions);
+    return static_cast<double>(a) * static_cast<double>(b);
+}
+
+inline std::any negate(int64_t a) {
+    if (a == 0) return -0.0;
+    return -a;
+}
+
+}
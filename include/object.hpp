@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// base of every runtime value that lives on the heap and is shared by reference
+class Object {
+public:
+    virtual ~Object() {}
+
+    size_t refCount = 0;
+};
+
+/*
+  Intrusive reference counted pointer to an Object. It is a single pointer
+  with a noexcept move, so unlike std::shared_ptr it fits std::any's small
+  buffer and boxing a reference never allocates. Counts are not atomic, a
+  value is only ever touched by one interpreter at a time.
+*/
+template <typename T>
+class Ref {
+    T *ptr = nullptr;
+
+    void retain() {
+        if (ptr) ptr->refCount++;
+    }
+
+    void release() {
+        if (ptr && --ptr->refCount == 0) delete ptr;
+    }
+
+public:
+    Ref() = default;
+
+    explicit Ref(T *ptr) : ptr(ptr) { retain(); }
+
+    Ref(const Ref& other) : ptr(other.ptr) { retain(); }
+
+    Ref(Ref&& other) noexcept : ptr(other.ptr) { other.ptr = nullptr; }
+
+    Ref& operator=(Ref other) noexcept {
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+
+    ~Ref() { release(); }
+
+    T* get() const { return ptr; }
+    T* operator->() const { return ptr; }
+    T& operator*() const { return *ptr; }
+
+    explicit operator bool() const { return ptr != nullptr; }
+
+    bool operator==(const Ref& other) const { return ptr == other.ptr; }
+    bool operator!=(const Ref& other) const { return ptr != other.ptr; }
+};
+
+template <typename T, typename... Args>
+Ref<T> make(Args&&... args) {
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "errors.hpp"
+#include "phase.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+
+/*
+  Scans a large source on several threads. The text is cut into chunks
+  right after a newline, and each chunk is scanned on a thread of its own
+  as if it began outside of any token. At the start of a line that holds
+  unless a string runs across the line break, comments end at the line
+  break anyway.
+
+  The chunk results are then stitched together in order. A chunk that ends
+  inside an open string hands over to a sequential fix-up, which scans on
+  from the string's opening quote until it stops exactly at the start of a
+  later chunk between two tokens; that chunk's result holds again from
+  there. Chunks count lines from 1 and are moved to their real line while
+  stitching. Errors are held back and reported in source order once it is
+  known which results are kept, so tokens and errors come out exactly as
+  from Scanner::scanTokens.
+*/
+class ParallelScanner {
+
+    // offsets where the chunks start, chunks is an upper bound
+    static std::vector<size_t> split(std::string_view source, size_t chunks) {
+        std::vector<size_t> starts{ 0 };
+
+        for (size_t i = 1; i < chunks; i++) {
+            size_t at = source.find('\n', std::max(source.size() * i / chunks, starts.back()));
+            if (at == std::string_view::npos || at + 1 >= source.size()) break;
+
+            starts.push_back(at + 1);
+        }
+
+        return starts;
+    }
+
+    // appends what a scanner found, its lines shifted by offset
+    static void take(Scanner &scanner, size_t offset, std::vector<Token> &tokens,
+                     std::vector<std::pair<int, std::string>> &errors) {
+        for (auto &token : scanner.tokens) {
+            token.line += static_cast<int>(offset);
+            tokens.push_back(std::move(token));
+        }
+
+        for (auto &[line, message] : scanner.deferred) errors.emplace_back(line + static_cast<int>(offset), std::move(message));
+    }
+
+public:
+    // chunks smaller than this are not worth a thread
+    static constexpr size_t MIN_CHUNK = 256 * 1024;
+
+    // the same as Scanner(source).scanTokens(), on up to threads threads
+    static std::vector<Token> scanTokens(std::string_view source, size_t threads, size_t minChunk = MIN_CHUNK) {
+        std::vector<size_t> starts = split(source, std::max<size_t>(1, std::min(threads, source.size() / minChunk)));
+        size_t chunks = starts.size();
+
+        std::vector<Scanner> scanners;
+        scanners.reserve(chunks);
+        for (size_t i = 0; i < chunks; i++) {
+            size_t end = i + 1 < chunks ? starts[i + 1] : source.size();
+            scanners.emplace_back(source.substr(starts[i], end - starts[i]));
+            scanners.back().deferErrors = true;
+            scanners.back().partial = true;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < chunks; i++) {
+            workers.emplace_back([&scanner = scanners[i]] {
+                Stats::phase = static_cast<int>(Phase::Scan);
+                scanner.scanRest();
+                Stats::flushThread();
+            });
+        }
+        scanners[0].scanRest();
+        for (auto &worker : workers) worker.join();
+
+        size_t count = 0;
+        for (auto &scanner : scanners) count += scanner.tokens.size();
+
+        std::vector<Token> tokens;
+        tokens.reserve(count + 1);
+        std::vector<std::pair<int, std::string>> errors;
+
+        // the line the stitched tokens have reached
+        size_t line = 1;
+
+        for (size_t k = 0; k < chunks; ) {
+            Scanner &chunk = scanners[k];
+            take(chunk, line - 1, tokens, errors);
+
+            if (chunk.openString == std::string_view::npos) {
+                line += chunk.line - 1;
+                k++;
+                continue;
+            }
+
+            // the fix-up, it ends at a chunk start or at the end of the source
+            size_t from = starts[k] + chunk.openString;
+            Scanner rest(source.substr(from), chunk.openLine + line - 1);
+            rest.deferErrors = true;
+
+            for (k++; !rest.isAtEnd(); ) {
+                rest.start = rest.current;
+                rest.scanToken();
+
+                size_t at = from + rest.current;
+                while (k < chunks && starts[k] < at) k++;
+                if (k < chunks && starts[k] == at) break;
+            }
+
+            take(rest, 0, tokens, errors);
+            line = rest.line;
+        }
+
+        for (auto &[at, message] : errors) Errors::error(at, message);
+
+        tokens.push_back(Token(TokenType::EndOfFile, "", "", line));
+        HD_STAT_ADD(tokensScanned, tokens.size());
+        return tokens;
+    }
+};
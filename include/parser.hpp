@@ -1,11 +1,17 @@
 #pragma once
 
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "tokens.hpp"
 #include "expression.hpp"
 #include "errors.hpp"
 #include "statement.hpp"
+#include "number.hpp"
 
 class ParseError : public std::runtime_error {
     public:
@@ -13,8 +19,31 @@ class ParseError : public std::runtime_error {
 };
 
 class Parser {
-    std::vector<Token> tokens;
-    int current = 0;
+    // shared with the bodies of skimmed functions, which are parsed later
+    std::shared_ptr<const std::vector<Token>> tokens;
+    size_t current = 0;
+
+    // skim the bodies of top level functions instead of building them
+    bool lazy;
+
+    // pipelined runs get their tokens in batches, see refill()
+    std::function<bool(std::vector<Token>&)> more;
+    std::shared_ptr<std::vector<Token>> window;
+
+    bool failed = false;
+
+    // the scopes the Resolver will see in the body being skimmed, innermost
+    // last, with whether each name is defined yet
+    std::vector<std::unordered_map<std::string, bool>> skimScopes;
+    // first scope of the function being skimmed, names below it belong to an enclosing one
+    size_t skimFrame = 0;
+    FunctionKind skimKind = FunctionKind::Function;
+    // the class the skimmed code is in, for 'this' and 'super'
+    enum class SkimClass { None, Class, Subclass } skimmedClass = SkimClass::None;
+    // what the Resolver would report, handed to it with the skimmed function
+    std::vector<std::pair<Token, std::string>> skimErrors;
+    // the identifier of the last Shape::Variable, see skimRead
+    size_t skimmed = 0;
 
     Expr* expression() {
         return assignment();
@@ -29,9 +58,29 @@ class Parser {
 
             if (auto var = dynamic_cast<VariableExpr*>(expr)) {
                 Token name = var->name;
+                delete expr;
                 return new AssignExpr(name, value);
             }
 
+            if (auto get = dynamic_cast<GetExpr*>(expr)) {
+                Expr *object = get->object;
+                Token name = get->name;
+
+                get->object = nullptr;
+                delete get;
+                return new SetExpr(object, name, value);
+            }
+
+            if (auto index = dynamic_cast<IndexExpr*>(expr)) {
+                Expr *object = index->object;
+                Expr *position = index->index;
+                Mark bracket = index->bracket;
+
+                index->object = index->index = nullptr;
+                delete index;
+                return new IndexSetExpr(object, bracket, position, value);
+            }
+
             error(equals, "Invalid assignment target");
         }
 
@@ -93,7 +142,62 @@ class Parser {
             return new UnaryExpr(Operator, right);
         }
 
-        return primary();
+        if (match({TokenType::AWAIT})) {
+            Token keyword = previous();
+            Expr *task = unary();
+            return new AwaitExpr(keyword, task);
+        }
+
+        if (match({TokenType::SPAWN})) {
+            Token keyword = previous();
+            Expr *expr = call();
+
+            auto target = dynamic_cast<CallExpr*>(expr);
+            if (!target) {
+                delete expr;
+                throw error(keyword, "Expect a function call after 'spawn'");
+            }
+
+            return new SpawnExpr(keyword, target);
+        }
+
+        return call();
+    }
+
+    Expr* call() {
+        Expr* expr = primary();
+
+        while (true) {
+            if (match({TokenType::LEFT_PAREN})) {
+                expr = finishCall(expr);
+            } else if (match({TokenType::DOT})) {
+                Token name = consume(TokenType::IDENTIFIER, "Expect property name after '.'");
+                expr = new GetExpr(expr, name);
+            } else if (match({TokenType::LEFT_BRACKET})) {
+                Token bracket = previous();
+                Expr *index = expression();
+                consume(TokenType::RIGHT_BRACKET, "Expect ']' after index");
+                expr = new IndexExpr(expr, bracket, index);
+            } else {
+                break;
+            }
+        }
+
+        return expr;
+    }
+
+    Expr* finishCall(Expr* callee) {
+        std::vector<Expr*> arguments;
+
+        if (!check(TokenType::RIGHT_PAREN)) {
+            do {
+                if (arguments.size() >= 255) error(peek(), "Can't have more than 255 arguments");
+                arguments.push_back(expression());
+            } while (match({TokenType::COMMA}));
+        }
+
+        Token paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments");
+        return new CallExpr(callee, paren, arguments);
     }
 
     Expr* primary() {
@@ -102,7 +206,7 @@ class Parser {
         if (match({TokenType::NIL})) return new LiteralExpr(nullptr);
         
         if (match({TokenType::NUMBER})) {
-            return new LiteralExpr(std::stod(previous().literal));
+            return new LiteralExpr(number::literal(std::stod(previous().literal)));
         }
 
         if (match({TokenType::STRING})) {
@@ -115,6 +219,29 @@ class Parser {
             return new GroupingExpr(expr);
         }
 
+        if (match({TokenType::LEFT_BRACKET})) {
+            Token bracket = previous();
+            std::vector<Expr*> elements;
+
+            if (!check(TokenType::RIGHT_BRACKET)) {
+                do {
+                    elements.push_back(expression());
+                } while (match({TokenType::COMMA}));
+            }
+
+            consume(TokenType::RIGHT_BRACKET, "Expect ']' after array elements");
+            return new ArrayExpr(bracket, elements);
+        }
+
+        if (match({TokenType::THIS})) return new ThisExpr(previous());
+
+        if (match({TokenType::SUPER})) {
+            Token keyword = previous();
+            consume(TokenType::DOT, "Expect '.' after 'super'");
+            Token method = consume(TokenType::IDENTIFIER, "Expect superclass method name");
+            return new SuperExpr(keyword, method);
+        }
+
         if (match({TokenType::IDENTIFIER})) {
             return new VariableExpr(previous());
         }
@@ -122,7 +249,7 @@ class Parser {
         throw error(peek(), "Expect expression");
     }
 
-    bool match(const std::vector<TokenType>& types) {
+    bool match(std::initializer_list<TokenType> types) {
         for (auto type : types) {
             if (check(type)) {
                 advance();
@@ -133,13 +260,14 @@ class Parser {
         return false;
     }
 
-    Token consume(TokenType type, std::string message) {
+    const Token& consume(TokenType type, const char *message) {
         if (check(type)) return advance();
 
         throw error(peek(), message);
     }
 
-    ParseError error(Token token, std::string message) {
+    ParseError error(const Token& token, const std::string& message) {
+        failed = true;
         Errors::error(token, message);
 
         return ParseError();
@@ -180,35 +308,126 @@ class Parser {
         return peek().type == type;
     }
 
-    Token advance() {
+    const Token& advance() {
         if (!isAtEnd())
             current++;
-        
+
+        // only a batch of a pipelined run can end without EndOfFile
+        if (current == tokens->size()) refill();
+
         return previous();
     }
 
+    // replaces the window with the next batch, keeping the last token for previous()
+    void refill() {
+        std::vector<Token> batch;
+        bool got = more(batch);
+        while (got && batch.empty()) got = more(batch);
+        int line = window->empty() ? 1 : window->back().line;
+
+        if (!window->empty()) {
+            Token last = std::move(window->back());
+            window->clear();
+            window->push_back(std::move(last));
+        }
+
+        window->insert(window->end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+
+        // the producer gave up, end the input here
+        if (!got) window->push_back(Token(TokenType::EndOfFile, "", "", line));
+
+        current = window->size() - batch.size() - !got;
+    }
+
     bool isAtEnd() {
         return peek().type == TokenType::EndOfFile;
     }
 
-    Token peek() {
-        return tokens.at(current);
+    const Token& peek() {
+        return (*tokens)[current];
     }
 
-    Token previous() {
-        return tokens.at(current - 1);
+    const Token& previous() {
+        return (*tokens)[current - 1];
     }
 
     Stmt* statement() {
         if (match({TokenType::PRINT})) return printStatement();
+        if (match({TokenType::LEFT_BRACE})) return new BlockStmt(block());
+        if (match({TokenType::IF})) return ifStatement();
+        if (match({TokenType::WHILE})) return whileStatement();
+        if (match({TokenType::FOR})) return forStatement();
+        if (match({TokenType::RETURN})) return returnStatement();
 
         return expressionStatement();
     }
 
     Stmt* printStatement() {
+        Mark keyword = previous();
         Expr *value = expression();
         consume(TokenType::SEMICOLON, "Expect ; after value");
-        return new PrintStmt(value);
+        return new PrintStmt(keyword, value);
+    }
+
+    Stmt* ifStatement() {
+        consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'");
+        Expr *condition = expression();
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition");
+
+        Stmt *thenBranch = statement();
+        Stmt *elseBranch = match({TokenType::ELSE}) ? statement() : nullptr;
+
+        return new IfStmt(condition, thenBranch, elseBranch);
+    }
+
+    Stmt* whileStatement() {
+        Mark keyword = previous();
+        consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'");
+        Expr *condition = expression();
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after condition");
+
+        return new WhileStmt(keyword, condition, statement(), nullptr);
+    }
+
+    // for (init; condition; increment) body is the block { init; while (condition) body }
+    // with the increment run by the loop after the body, no node is added per trip
+    Stmt* forStatement() {
+        Mark keyword = previous();
+        consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'");
+
+        Stmt *initializer = nullptr;
+        if (match({TokenType::VAR})) initializer = varDeclaration();
+        else if (!match({TokenType::SEMICOLON})) initializer = expressionStatement();
+
+        Expr *condition = check(TokenType::SEMICOLON) ? new LiteralExpr(true) : expression();
+        consume(TokenType::SEMICOLON, "Expect ';' after loop condition");
+
+        Expr *increment = check(TokenType::RIGHT_PAREN) ? nullptr : expression();
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses");
+
+        Stmt *loop = new WhileStmt(keyword, condition, statement(), increment);
+        if (!initializer) return loop;
+
+        return new BlockStmt({ initializer, loop });
+    }
+
+    Stmt* returnStatement() {
+        Token keyword = previous();
+        Expr *value = check(TokenType::SEMICOLON) ? nullptr : expression();
+
+        consume(TokenType::SEMICOLON, "Expect ; after return value");
+        return new ReturnStmt(keyword, value);
+    }
+
+    std::vector<Stmt*> block() {
+        std::vector<Stmt*> statements;
+
+        while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+            statements.push_back(declaration());
+        }
+
+        consume(TokenType::RIGHT_BRACE, "Expect '}' after block");
+        return statements;
     }
 
     Stmt* expressionStatement() {
@@ -217,8 +436,10 @@ class Parser {
         return new ExpressionStmt(expr);
     }
 
-    Stmt* declaration() {
+    Stmt* declaration(bool topLevel = false) {
         try {
+            if (match({TokenType::CLASS})) return classDeclaration();
+            if (match({TokenType::FUN})) return function(FunctionKind::Function, topLevel && lazy);
             if (match({TokenType::VAR})) return varDeclaration();
 
             return statement();
@@ -228,6 +449,401 @@ class Parser {
         }
     }
 
+    Stmt* classDeclaration() {
+        Token name = consume(TokenType::IDENTIFIER, "Expect class name");
+
+        VariableExpr *superclass = nullptr;
+        if (match({TokenType::LESS})) {
+            consume(TokenType::IDENTIFIER, "Expect superclass name");
+            superclass = new VariableExpr(previous());
+        }
+
+        consume(TokenType::LEFT_BRACE, "Expect '{' before class body");
+
+        std::vector<FunStmt*> methods;
+        while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+            FunctionKind kind = peek().lexeme == "init" ? FunctionKind::Initializer : FunctionKind::Method;
+            methods.push_back(function(kind));
+        }
+
+        consume(TokenType::RIGHT_BRACE, "Expect '}' after class body");
+        return new ClassStmt(name, superclass, methods);
+    }
+
+    FunStmt* function(FunctionKind kind, bool skim = false) {
+        Token name = consume(TokenType::IDENTIFIER, kind == FunctionKind::Function ? "Expect function name" : "Expect method name");
+        std::vector<Token> params = parameters();
+
+        consume(TokenType::LEFT_BRACE, "Expect '{' before function body");
+
+        if (skim) {
+            size_t start = current;
+            skimScopes.clear();
+            skimmedClass = SkimClass::None;
+            skimErrors.clear();
+            skimBody(kind, params);
+
+            HD_STAT(lazyFunctions);
+            auto function = new FunStmt(name, params, {}, kind);
+            function->lazy = std::make_unique<LazyBody>(tokens, start);
+            function->lazy->errors = std::move(skimErrors);
+            return function;
+        }
+
+        std::vector<Stmt*> body = block();
+
+        return new FunStmt(name, params, body, kind);
+    }
+
+    std::vector<Token> parameters() {
+        consume(TokenType::LEFT_PAREN, "Expect '(' after function name");
+
+        std::vector<Token> params;
+        if (!check(TokenType::RIGHT_PAREN)) {
+            do {
+                if (params.size() >= 255) error(peek(), "Can't have more than 255 parameters");
+                params.push_back(consume(TokenType::IDENTIFIER, "Expect parameter name"));
+            } while (match({TokenType::COMMA}));
+        }
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters");
+
+        return params;
+    }
+
+    /*
+      Skimming checks the syntax of a function body without building it: a
+      recognizer for the same grammar, reporting the same errors and
+      recovering the same way as the parser above. Precedence doesn't change
+      what is valid, so binary operators are one flat loop. The shape of an
+      expression is all that is kept, to check assignment targets and spawn.
+
+      The scopes of the body are tracked the way the Resolver will track
+      them, so that its errors (a name declared twice in a scope, a local read
+      in its own initializer, a local of an enclosing function, 'this' and
+      'super' outside of a class, a value returned from init) are found
+      before the script runs. They are kept on the LazyBody, and the Resolver
+      reports them when it gets to the function, in its usual order.
+    */
+    enum class Shape { Other, Variable, Get, Index, Call };
+
+    void skimBlock() {
+        while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) skimDeclaration();
+
+        consume(TokenType::RIGHT_BRACE, "Expect '}' after block");
+    }
+
+    void skimError(const Token& token, const std::string& message) {
+        skimErrors.emplace_back(token, message);
+    }
+
+    void skimDeclare(const Token& name) {
+        auto &scope = skimScopes.back();
+        if (scope.count(name.lexeme)) skimError(name, "Already a variable with this name in this scope");
+        scope[name.lexeme] = false;
+    }
+
+    void skimDefine(const Token& name) {
+        skimScopes.back()[name.lexeme] = true;
+    }
+
+    // a use of a name; only reads, not assignments, can be in its own initializer
+    void skimLookup(const Token& name, bool read) {
+        if (read) {
+            auto &scope = skimScopes.back();
+            if (auto it = scope.find(name.lexeme); it != scope.end() && !it->second) {
+                skimError(name, "Can't read local variable in its own initializer");
+            }
+        }
+
+        for (size_t i = skimScopes.size(); i-- > 0; ) {
+            if (!skimScopes[i].count(name.lexeme)) continue;
+
+            if (i < skimFrame) skimError(name, "Can't capture local variable of an enclosing function");
+            return;
+        }
+    }
+
+    // the shape of an operand, reading the variable when it is one
+    Shape skimRead(Shape shape) {
+        if (shape == Shape::Variable) skimLookup((*tokens)[skimmed], true);
+        return shape;
+    }
+
+    // the parameters and statements of a body share the function's scope
+    void skimBody(FunctionKind kind, const std::vector<Token>& params) {
+        // a top level function's parameters are checked by the Resolver itself
+        bool nested = !skimScopes.empty();
+
+        size_t enclosingFrame = skimFrame;
+        FunctionKind enclosingKind = skimKind;
+        skimFrame = skimScopes.size();
+        skimKind = kind;
+
+        skimScopes.emplace_back();
+        if (kind != FunctionKind::Function) skimScopes.back()["this"] = true;
+
+        for (auto &param : params) {
+            if (nested) skimDeclare(param);
+            skimDefine(param);
+        }
+
+        skimBlock();
+
+        skimScopes.pop_back();
+        skimFrame = enclosingFrame;
+        skimKind = enclosingKind;
+    }
+
+    void skimVar() {
+        Token name = consume(TokenType::IDENTIFIER, "Expect variable name");
+        skimDeclare(name);
+        if (match({TokenType::EQUAL})) skimExpression();
+        skimDefine(name);
+
+        consume(TokenType::SEMICOLON, "Expect ; after variable declaration");
+    }
+
+    // a nested function or a method, not counted as lazy: it is parsed
+    // eagerly along with the body holding it
+    void skimFunction(FunctionKind kind) {
+        Token name = consume(TokenType::IDENTIFIER, kind == FunctionKind::Function ? "Expect function name" : "Expect method name");
+        if (kind == FunctionKind::Function) {
+            skimDeclare(name);
+            skimDefine(name);
+        }
+        std::vector<Token> params = parameters();
+
+        consume(TokenType::LEFT_BRACE, "Expect '{' before function body");
+        skimBody(kind, params);
+    }
+
+    void skimDeclaration() {
+        // a syntax error can leave scopes, a function or a class open
+        size_t scopes = skimScopes.size(), frame = skimFrame;
+        FunctionKind kind = skimKind;
+        SkimClass klass = skimmedClass;
+
+        try {
+            if (match({TokenType::CLASS})) {
+                skimClass();
+            } else if (match({TokenType::FUN})) {
+                skimFunction(FunctionKind::Function);
+            } else if (match({TokenType::VAR})) {
+                skimVar();
+            } else {
+                skimStatement();
+            }
+        } catch (ParseError &error) {
+            skimScopes.resize(scopes);
+            skimFrame = frame;
+            skimKind = kind;
+            skimmedClass = klass;
+            synchronize();
+        }
+    }
+
+    void skimClass() {
+        Token name = consume(TokenType::IDENTIFIER, "Expect class name");
+        skimDeclare(name);
+        skimDefine(name);
+
+        SkimClass enclosing = skimmedClass;
+        skimmedClass = SkimClass::Class;
+
+        if (match({TokenType::LESS})) {
+            Token superclass = consume(TokenType::IDENTIFIER, "Expect superclass name");
+            if (superclass.lexeme == name.lexeme) skimError(superclass, "A class can't inherit from itself");
+            skimLookup(superclass, true);
+            skimmedClass = SkimClass::Subclass;
+        }
+
+        consume(TokenType::LEFT_BRACE, "Expect '{' before class body");
+        while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+            FunctionKind kind = peek().lexeme == "init" ? FunctionKind::Initializer : FunctionKind::Method;
+            skimFunction(kind);
+        }
+        consume(TokenType::RIGHT_BRACE, "Expect '}' after class body");
+
+        skimmedClass = enclosing;
+    }
+
+    void skimStatement() {
+        if (match({TokenType::PRINT})) {
+            skimExpression();
+            consume(TokenType::SEMICOLON, "Expect ; after value");
+        } else if (match({TokenType::LEFT_BRACE})) {
+            skimScopes.emplace_back();
+            skimBlock();
+            skimScopes.pop_back();
+        } else if (match({TokenType::IF})) {
+            consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'");
+            skimExpression();
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition");
+
+            skimStatement();
+            if (match({TokenType::ELSE})) skimStatement();
+        } else if (match({TokenType::WHILE})) {
+            consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'");
+            skimExpression();
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after condition");
+
+            skimStatement();
+        } else if (match({TokenType::FOR})) {
+            consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'");
+
+            // a loop with an initializer is a block around it
+            bool initializer = !check(TokenType::SEMICOLON);
+            if (initializer) skimScopes.emplace_back();
+
+            if (match({TokenType::VAR})) {
+                skimVar();
+            } else if (!match({TokenType::SEMICOLON})) {
+                skimExpression();
+                consume(TokenType::SEMICOLON, "Expect ; after value");
+            }
+
+            if (!check(TokenType::SEMICOLON)) skimExpression();
+            consume(TokenType::SEMICOLON, "Expect ';' after loop condition");
+            if (!check(TokenType::RIGHT_PAREN)) skimExpression();
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses");
+
+            skimStatement();
+            if (initializer) skimScopes.pop_back();
+        } else if (match({TokenType::RETURN})) {
+            Token keyword = previous();
+            if (!check(TokenType::SEMICOLON)) {
+                if (skimKind == FunctionKind::Initializer) skimError(keyword, "Can't return a value from an initializer");
+                skimExpression();
+            }
+            consume(TokenType::SEMICOLON, "Expect ; after return value");
+        } else {
+            skimExpression();
+            consume(TokenType::SEMICOLON, "Expect ; after value");
+        }
+    }
+
+    Shape skimExpression() {
+        Shape shape = skimBinary();
+
+        if (match({TokenType::EQUAL})) {
+            const Token &equals = previous();
+            size_t target = skimmed;
+            skimExpression();
+
+            if (shape == Shape::Variable) skimLookup((*tokens)[target], false);
+            if (shape == Shape::Variable || shape == Shape::Get || shape == Shape::Index) return Shape::Other;
+            error(equals, "Invalid assignment target");
+        }
+
+        return skimRead(shape);
+    }
+
+    Shape skimBinary() {
+        Shape shape = skimUnary();
+
+        while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL, TokenType::GREATER, TokenType::GREATER_EQUAL,
+                      TokenType::LESS, TokenType::LESS_EQUAL, TokenType::MINUS, TokenType::PLUS,
+                      TokenType::SLASH, TokenType::STAR})) {
+            skimRead(shape);
+            skimRead(skimUnary());
+            shape = Shape::Other;
+        }
+
+        return shape;
+    }
+
+    Shape skimUnary() {
+        if (match({TokenType::BANG, TokenType::MINUS, TokenType::AWAIT})) {
+            skimRead(skimUnary());
+            return Shape::Other;
+        }
+
+        if (match({TokenType::SPAWN})) {
+            const Token &keyword = previous();
+            if (skimCall() != Shape::Call) throw error(keyword, "Expect a function call after 'spawn'");
+            return Shape::Other;
+        }
+
+        return skimCall();
+    }
+
+    Shape skimCall() {
+        Shape shape = skimPrimary();
+
+        while (true) {
+            if (match({TokenType::LEFT_PAREN})) {
+                skimRead(shape);
+                if (!check(TokenType::RIGHT_PAREN)) {
+                    size_t arguments = 0;
+                    do {
+                        if (arguments++ >= 255) error(peek(), "Can't have more than 255 arguments");
+                        skimExpression();
+                    } while (match({TokenType::COMMA}));
+                }
+                consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments");
+                shape = Shape::Call;
+            } else if (match({TokenType::DOT})) {
+                skimRead(shape);
+                consume(TokenType::IDENTIFIER, "Expect property name after '.'");
+                shape = Shape::Get;
+            } else if (match({TokenType::LEFT_BRACKET})) {
+                skimRead(shape);
+                skimExpression();
+                consume(TokenType::RIGHT_BRACKET, "Expect ']' after index");
+                shape = Shape::Index;
+            } else {
+                return shape;
+            }
+        }
+    }
+
+    Shape skimPrimary() {
+        if (match({TokenType::FALSE, TokenType::TRUE, TokenType::NIL, TokenType::NUMBER, TokenType::STRING})) {
+            return Shape::Other;
+        }
+
+        if (match({TokenType::IDENTIFIER})) {
+            skimmed = current - 1;
+            return Shape::Variable;
+        }
+
+        if (match({TokenType::THIS})) {
+            Token keyword = previous();
+            if (skimmedClass == SkimClass::None) skimError(keyword, "Can't use 'this' outside of a class");
+            else skimLookup(keyword, false);
+            return Shape::Other;
+        }
+
+        if (match({TokenType::LEFT_PAREN})) {
+            skimExpression();
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after expression");
+            return Shape::Other;
+        }
+
+        if (match({TokenType::LEFT_BRACKET})) {
+            if (!check(TokenType::RIGHT_BRACKET)) {
+                do {
+                    skimExpression();
+                } while (match({TokenType::COMMA}));
+            }
+            consume(TokenType::RIGHT_BRACKET, "Expect ']' after array elements");
+            return Shape::Other;
+        }
+
+        if (match({TokenType::SUPER})) {
+            Token keyword = previous();
+            consume(TokenType::DOT, "Expect '.' after 'super'");
+            consume(TokenType::IDENTIFIER, "Expect superclass method name");
+
+            if (skimmedClass == SkimClass::None) skimError(keyword, "Can't use 'super' outside of a class");
+            else if (skimmedClass == SkimClass::Class) skimError(keyword, "Can't use 'super' in a class with no superclass");
+            else skimLookup(Token(TokenType::THIS, "this", "", keyword.line), false);
+            return Shape::Other;
+        }
+
+        throw error(peek(), "Expect expression");
+    }
+
     Stmt* varDeclaration() {
         Token name = consume(TokenType::IDENTIFIER, "Expect variable name");
 
@@ -238,15 +854,50 @@ class Parser {
     }
 
 public:
-    Parser(const std::vector<Token>& tokens) : tokens(tokens) {}
+    Parser(std::vector<Token> tokens, bool lazy = true)
+    : tokens(std::make_shared<const std::vector<Token>>(std::move(tokens))), lazy(lazy) {}
+
+    Parser(std::shared_ptr<const std::vector<Token>> tokens) : tokens(std::move(tokens)), lazy(false) {}
+
+    // tokens arrive in batches from more(), which returns false when there are
+    // no more; only the current statement's tokens are kept
+    Parser(std::function<bool(std::vector<Token>&)> more)
+    : lazy(false), more(std::move(more)), window(std::make_shared<std::vector<Token>>()) {
+        tokens = window;
+        refill();
+    }
 
     std::vector<Stmt*> parse() {
         std::vector<Stmt*> statements; 
 
         while(!isAtEnd()) {
-            statements.push_back(declaration());
+            statements.push_back(declaration(true));
         }
 
         return statements;
     }
+
+    // one top level statement at a time, for pipelined runs; false at the end.
+    // A statement with syntax errors comes back null or incomplete, see hadError()
+    bool parseNext(Stmt *&stmt) {
+        if (isAtEnd()) return false;
+
+        stmt = declaration(true);
+        return true;
+    }
+
+    bool hadError() const {
+        return failed;
+    }
+
+    // line of the last token taken
+    int line() {
+        return previous().line;
+    }
+
+    // the statements of a skimmed body, from the token after its '{'
+    std::vector<Stmt*> parseBody(size_t start) {
+        current = start;
+        return block();
+    }
 };
\ No newline at end of file
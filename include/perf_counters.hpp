@@ -0,0 +1,278 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "phase.hpp"
+
+/*
+  Per phase hardware counters for hd --perf-counters. On Linux the counters
+  are opened with perf_event_open as one group, enabled around each phase of
+  HD::run and read back when the phase ends. They are inherited by the
+  threads started later, so scanner threads and task pool workers count
+  towards the phase they run in. When the kernel refuses hardware events
+  (perf_event_paranoid, containers, VMs without a PMU) we fall back to the
+  software events, and failing that to wall clock time only.
+*/
+
+class PerfCounters {
+public:
+    enum class Mode { Hardware, Software, Timer };
+
+    enum Event { Cycles, Instructions, CacheReferences, CacheMisses, Branches, BranchMisses,
+                 TaskClock, PageFaults, ContextSwitches, EVENT_COUNT };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PhaseReading {
+        double wallNs = 0;
+        uint64_t values[EVENT_COUNT] = {};
+        bool scaled = false;
+
+        // runs of the phase the group was and wasn't scheduled for; the
+        // values of a run the PMU never got to are not readings, just zeros.
+        // Phases that never ran on their own, like scan and parse of a
+        // streaming run, have neither
+        int counted = 0, missed = 0;
+    };
+
+    Mode mode = Mode::Timer;
+    std::string fallbackReason;
+
+    // file descriptor per event, -1 when the event could not be opened
+    int fds[EVENT_COUNT];
+    int leader = -1;
+
+    PhaseReading phases[static_cast<int>(Phase::__COUNT)];
+
+#ifdef __linux__
+    struct EventSpec { Event event; uint32_t type; uint64_t config; };
+
+    // value, time_enabled and time_running of one event, summed over the threads
+    struct Sample { uint64_t value = 0, enabled = 0, running = 0; };
+
+    // each event as the phase started. A reset doesn't reach what threads
+    // that already exited counted, so phases are told apart by difference
+    Sample begin[EVENT_COUNT];
+
+    bool sample(int event, Sample &out) const {
+        return fds[event] >= 0 && read(fds[event], &out, sizeof(out)) == sizeof(out);
+    }
+
+    static int open(uint32_t type, uint64_t config, int groupFd) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = groupFd == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // a group read only sees the leader's own thread, so with inherit each event is read by itself
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+
+    // opens the first event as group leader and as many of the rest as the PMU allows
+    bool openGroup(const std::vector<EventSpec>& specs) {
+        leader = open(specs[0].type, specs[0].config, -1);
+        if (leader < 0) return false;
+
+        fds[specs[0].event] = leader;
+
+        for (size_t i = 1; i < specs.size(); i++) {
+            int fd = open(specs[i].type, specs[i].config, leader);
+            if (fd >= 0) fds[specs[i].event] = fd;
+        }
+
+        return true;
+    }
+#endif
+
+    void closeAll() {
+#ifdef __linux__
+        for (int &fd : fds) {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+#endif
+        leader = -1;
+    }
+
+    void start() {
+#ifdef __linux__
+        if (leader < 0) return;
+        for (int event = 0; event < EVENT_COUNT; event++) sample(event, begin[event]);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    void stop(PhaseReading &reading) {
+#ifdef __linux__
+        if (leader < 0) return;
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        Sample end[EVENT_COUNT];
+        for (int event = 0; event < EVENT_COUNT; event++) sample(event, end[event]);
+
+        // the group is scheduled as a whole, the leader's times hold for every event
+        int first = 0;
+        while (fds[first] != leader) first++;
+
+        uint64_t enabled = end[first].enabled - begin[first].enabled;
+        uint64_t running = end[first].running - begin[first].running;
+        if (running == 0 && enabled > 0) {
+            reading.missed++;
+            return;
+        }
+        reading.counted++;
+
+        double scale = running > 0 && running < enabled ? static_cast<double>(enabled) / running : 1;
+        if (scale != 1) reading.scaled = true;
+
+        for (int event = 0; event < EVENT_COUNT; event++) {
+            if (fds[event] >= 0) reading.values[event] += static_cast<uint64_t>((end[event].value - begin[event].value) * scale);
+        }
+#else
+        (void) reading;
+#endif
+    }
+
+    bool has(Event event) const {
+        return fds[event] >= 0;
+    }
+
+    static double ratio(uint64_t a, uint64_t b) {
+        return b ? static_cast<double>(a) / b : 0;
+    }
+
+public:
+    PerfCounters() {
+        for (int &fd : fds) fd = -1;
+
+#ifdef __linux__
+        std::vector<EventSpec> hardware = {
+            { Cycles,          PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { Instructions,    PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { CacheReferences, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+            { CacheMisses,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { Branches,        PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+            { BranchMisses,    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        };
+
+        std::vector<EventSpec> software = {
+            { TaskClock,       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+            { PageFaults,      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+            { ContextSwitches, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+        };
+
+        if (openGroup(hardware)) {
+            mode = Mode::Hardware;
+            return;
+        }
+
+        fallbackReason = std::string("hardware counters unavailable: ") + std::strerror(errno);
+        closeAll();
+
+        if (openGroup(software)) {
+            mode = Mode::Software;
+            return;
+        }
+
+        fallbackReason += std::string(", software counters unavailable: ") + std::strerror(errno);
+        closeAll();
+#else
+        fallbackReason = "perf_event_open is only available on Linux";
+#endif
+    }
+
+    ~PerfCounters() {
+        closeAll();
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    Mode getMode() const { return mode; }
+
+    // counts one phase for as long as it is alive, does nothing for a null PerfCounters
+    class Scope {
+        PerfCounters *counters;
+        Phase phase;
+        Clock::time_point begin;
+
+    public:
+        Scope(PerfCounters *counters, Phase phase) : counters(counters), phase(phase) {
+            if (!counters) return;
+            begin = Clock::now();
+            counters->start();
+        }
+
+        ~Scope() {
+            if (!counters) return;
+
+            PhaseReading &reading = counters->phases[static_cast<int>(phase)];
+            counters->stop(reading);
+            reading.wallNs += std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+        }
+    };
+
+    void report(std::ostream& out) {
+        static const char* modes[] = { "hardware", "software", "timer" };
+
+        out << "\nperf counters (" << modes[static_cast<int>(mode)] << ")\n";
+        if (!fallbackReason.empty()) out << fallbackReason << "\n";
+
+        out << std::fixed;
+
+        for (int i = 0; i < static_cast<int>(Phase::__COUNT); i++) {
+            const PhaseReading &r = phases[i];
+
+            out << std::left << std::setw(10) << phaseName(static_cast<Phase>(i)) << std::right
+                << std::setprecision(3) << std::setw(10) << r.wallNs / 1e6 << " ms";
+
+            if (mode != Mode::Timer && !r.counted) {
+                out << "  not counted\n";
+                continue;
+            }
+
+            if (mode == Mode::Hardware) {
+                const uint64_t *v = r.values;
+                out << std::setw(14) << v[Cycles] << " cycles"
+                    << std::setw(14) << v[Instructions] << " instr";
+                if (has(Instructions)) out << std::setprecision(2) << std::setw(7) << ratio(v[Instructions], v[Cycles]) << " IPC";
+                if (has(CacheMisses) && has(CacheReferences))
+                    out << std::setprecision(2) << std::setw(7) << 100 * ratio(v[CacheMisses], v[CacheReferences]) << "% cache miss";
+                if (has(BranchMisses) && has(Branches))
+                    out << std::setprecision(2) << std::setw(7) << 100 * ratio(v[BranchMisses], v[Branches]) << "% branch miss";
+            }
+
+            if (mode == Mode::Software) {
+                const uint64_t *v = r.values;
+                out << std::setprecision(3) << std::setw(10) << v[TaskClock] / 1e6 << " ms on cpu";
+                if (has(PageFaults)) out << std::setw(10) << v[PageFaults] << " page faults";
+                if (has(ContextSwitches)) out << std::setw(8) << v[ContextSwitches] << " ctx switches";
+            }
+
+            if (r.scaled) out << "  (multiplexed, scaled)";
+            if (r.missed) out << "  (not counted in " << r.missed << " of " << r.missed + r.counted << " runs)";
+            out << "\n";
+        }
+    }
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+// stages of the pipeline that HD::run goes through
+enum class Phase { Scan, Parse, Interpret, __COUNT };
+
+inline const char* phaseName(Phase phase) {
+    static const char* names[] = { "scan", "parse", "interpret" };
+    return names[static_cast<int>(phase)];
+}
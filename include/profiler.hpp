@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cxxabi.h>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "string_util.hpp"
+
+/*
+  Source level profiler. The interpreter calls enter/exit around every node
+  it evaluates while a profiler is attached; time and evaluation counts are
+  attributed to the node and to its source line. Self time is also collected
+  per call stack so it can be written out in the collapsed format understood
+  by flamegraph.pl and similar tools.
+*/
+
+// finds the source line of a node from the tokens it carries, -1 if it has none
+class LineFinder : public ExprVisitor, public StmtVisitor {
+    int line = -1;
+
+public:
+    int of(Expr *expr) {
+        return std::any_cast<int>(expr->accept(this));
+    }
+
+    int of(Stmt *stmt) {
+        line = -1;
+        stmt->accept(this);
+        return line;
+    }
+
+    std::any visitBinaryExpr(BinaryExpr *expr) override { return expr->Operator.line; }
+    std::any visitGroupingExpr(GroupingExpr *expr) override { return of(expr->expression); }
+    std::any visitLiteralExpr(LiteralExpr *) override { return -1; }
+    std::any visitUnaryExpr(UnaryExpr *expr) override { return expr->Operator.line; }
+    std::any visitVariableExpr(VariableExpr *expr) override { return expr->name.line; }
+    std::any visitAssignExpr(AssignExpr *expr) override { return expr->name.line; }
+    std::any visitCallExpr(CallExpr *expr) override { return expr->paren.line; }
+    std::any visitGetExpr(GetExpr *expr) override { return expr->name.line; }
+    std::any visitSetExpr(SetExpr *expr) override { return expr->name.line; }
+    std::any visitThisExpr(ThisExpr *expr) override { return expr->keyword.line; }
+    std::any visitSuperExpr(SuperExpr *expr) override { return expr->keyword.line; }
+    std::any visitArrayExpr(ArrayExpr *expr) override { return expr->bracket.line; }
+    std::any visitIndexExpr(IndexExpr *expr) override { return expr->bracket.line; }
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override { return expr->bracket.line; }
+    std::any visitSpawnExpr(SpawnExpr *expr) override { return expr->keyword.line; }
+    std::any visitAwaitExpr(AwaitExpr *expr) override { return expr->keyword.line; }
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override { return expr->name.line; }
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override { return expr->Operator.line; }
+    std::any visitVarVarExpr(VarVarExpr *expr) override { return expr->Operator.line; }
+
+    void visitExpressionStmt(ExpressionStmt *stmt) override { line = of(stmt->expression); }
+    void visitPrintStmt(PrintStmt *stmt) override { line = stmt->keyword.line; }
+    void visitVarStmt(VarStmt *stmt) override { line = stmt->name.line; }
+    void visitFunStmt(FunStmt *stmt) override { line = stmt->name.line; }
+    void visitReturnStmt(ReturnStmt *stmt) override { line = stmt->keyword.line; }
+    void visitIfStmt(IfStmt *stmt) override { line = of(stmt->condition); }
+    void visitWhileStmt(WhileStmt *stmt) override { line = stmt->keyword.line; }
+    void visitClassStmt(ClassStmt *stmt) override { line = stmt->name.line; }
+    void visitBlockStmt(BlockStmt *stmt) override {
+        for (auto inner : stmt->statements) {
+            if (inner && (line = of(inner)) >= 0) return;
+        }
+    }
+};
+
+class Profiler {
+    using Clock = std::chrono::steady_clock;
+
+    struct NodeStats {
+        std::string kind;
+        int line;
+        uint64_t count = 0;
+        double totalNs = 0, selfNs = 0;
+
+        // evaluations of this node currently on the stack, see LineStats::active
+        int active = 0;
+    };
+
+    struct LineStats {
+        uint64_t count = 0;
+        double totalNs = 0, selfNs = 0;
+
+        // frames of this line currently on the stack, so recursion is not counted twice
+        int active = 0;
+    };
+
+    struct Frame {
+        NodeStats *node;
+        Clock::time_point entered, start;
+        double childNs;
+        size_t pathLength;
+    };
+
+    std::unordered_map<const void*, NodeStats> nodes;
+    std::map<int, LineStats> lines;
+    std::vector<Frame> stack;
+
+    // collapsed call stacks and the self time spent in them
+    std::string path = "script";
+    std::unordered_map<std::string, double> folded;
+
+    LineFinder lineFinder;
+
+    static std::string demangle(const std::type_info& type) {
+        int status = 0;
+        char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        std::string result = status == 0 ? name : type.name();
+        std::free(name);
+        return result;
+    }
+
+    template <typename Node>
+    NodeStats& lookup(Node *node) {
+        auto it = nodes.find(node);
+        if (it != nodes.end()) return it->second;
+
+        int line = lineFinder.of(node);
+
+        // literals and the like run on the line of whatever evaluates them
+        if (line < 0) line = stack.empty() ? 0 : stack.back().node->line;
+
+        return nodes.emplace(node, NodeStats{ demangle(typeid(*node)), line }).first->second;
+    }
+
+    template <typename Node>
+    void enter(Node *node) {
+        auto entered = Clock::now();
+        NodeStats &stats = lookup(node);
+
+        size_t pathLength = path.size();
+        path += ';';
+        path += stats.kind;
+        path += ':';
+        path += std::to_string(stats.line);
+
+        stats.active++;
+        lines[stats.line].active++;
+        stack.push_back({ &stats, entered, Clock::now(), 0, pathLength });
+    }
+
+    void exit() {
+        auto end = Clock::now();
+
+        Frame frame = stack.back();
+        stack.pop_back();
+
+        double totalNs = std::chrono::duration<double, std::nano>(end - frame.start).count();
+        double selfNs = totalNs - frame.childNs;
+
+        frame.node->count++;
+        frame.node->selfNs += selfNs;
+        if (--frame.node->active == 0) frame.node->totalNs += totalNs;
+
+        LineStats &line = lines[frame.node->line];
+        line.count++;
+        line.selfNs += selfNs;
+        if (--line.active == 0) line.totalNs += totalNs;
+
+        folded[path] += selfNs;
+        path.resize(frame.pathLength);
+
+        // the parent is charged for the child including the bookkeeping above,
+        // so profiler overhead never shows up as self time
+        if (!stack.empty()) {
+            stack.back().childNs += std::chrono::duration<double, std::nano>(Clock::now() - frame.entered).count();
+        }
+    }
+
+public:
+    // RAII guard, so frames are popped even when a RuntimeError unwinds through them
+    class Scope {
+        Profiler &profiler;
+
+    public:
+        template <typename Node>
+        Scope(Profiler &profiler, Node *node) : profiler(profiler) {
+            profiler.enter(node);
+        }
+
+        ~Scope() { profiler.exit(); }
+    };
+
+    void report(const std::string& source, std::ostream& out, size_t top = 10) {
+        std::vector<std::string> sourceLines;
+        std::istringstream in(source);
+        for (std::string text; std::getline(in, text); ) sourceLines.push_back(trim_copy(text));
+
+        double totalNs = 0;
+        for (auto& [line, stats] : lines) totalNs += stats.selfNs;
+
+        std::vector<std::pair<int, LineStats>> hottest(lines.begin(), lines.end());
+        std::sort(hottest.begin(), hottest.end(), [](auto& a, auto& b) { return a.second.selfNs > b.second.selfNs; });
+        if (hottest.size() > top) hottest.resize(top);
+
+        out << "\nhottest lines\n";
+        out << std::right << std::setw(6) << "line" << std::setw(12) << "evals"
+            << std::setw(12) << "self ms" << std::setw(12) << "total ms" << std::setw(8) << "self%" << "  source\n";
+        out << std::fixed << std::setprecision(3);
+
+        for (auto& [line, stats] : hottest) {
+            std::string text = line >= 1 && line <= (int) sourceLines.size() ? sourceLines[line - 1] : "";
+            if (text.size() > 60) text = text.substr(0, 57) + "...";
+
+            out << std::setw(6) << line << std::setw(12) << stats.count
+                << std::setw(12) << stats.selfNs / 1e6 << std::setw(12) << stats.totalNs / 1e6
+                << std::setw(7) << std::setprecision(1) << (totalNs > 0 ? 100 * stats.selfNs / totalNs : 0) << "%"
+                << std::setprecision(3) << "  " << text << "\n";
+        }
+
+        std::vector<const NodeStats*> hotNodes;
+        for (auto& [node, stats] : nodes) hotNodes.push_back(&stats);
+        std::sort(hotNodes.begin(), hotNodes.end(), [](auto a, auto b) { return a->selfNs > b->selfNs; });
+        if (hotNodes.size() > top) hotNodes.resize(top);
+
+        out << "\nhottest nodes\n";
+        out << std::left << std::setw(20) << "node" << std::right << std::setw(6) << "line"
+            << std::setw(12) << "evals" << std::setw(12) << "self ms" << std::setw(12) << "total ms" << "\n";
+
+        for (auto stats : hotNodes) {
+            out << std::left << std::setw(20) << stats->kind << std::right << std::setw(6) << stats->line
+                << std::setw(12) << stats->count << std::setw(12) << stats->selfNs / 1e6
+                << std::setw(12) << stats->totalNs / 1e6 << "\n";
+        }
+    }
+
+    // one "frame;frame;frame nanoseconds" line per distinct stack
+    void writeCollapsed(std::ostream& out) {
+        std::vector<std::pair<std::string, double>> stacks(folded.begin(), folded.end());
+        std::sort(stacks.begin(), stacks.end());
+
+        for (auto& [stack, ns] : stacks) {
+            if (ns >= 1) out << stack << " " << std::llround(ns) << "\n";
+        }
+    }
+};
@@ -0,0 +1,421 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "errors.hpp"
+#include "symbol.hpp"
+
+/*
+  Static pass that runs between parsing and interpreting. Every local
+  variable gets a slot in its frame, so the interpreter can keep locals in a
+  flat array instead of a map per block. Names that are not declared in any
+  enclosing block are left at slot -1 and looked up in the global
+  Environment at runtime.
+
+  Each function gets a frame of its own with the parameters in the first
+  slots. Functions do not close over the locals of an enclosing function,
+  they can only see their own locals and globals. Methods are functions
+  whose slot 0 holds 'this'.
+
+  Globals mentioned inside a loop are numbered per innermost loop of their
+  function, the interpreter keeps what they resolve to in a cache for the
+  loop while it runs.
+*/
+class Resolver : public ExprVisitor, public StmtVisitor {
+
+    struct Local {
+        int slot;
+        bool defined;
+    };
+
+    std::vector<std::unordered_map<std::string, Local>> scopes;
+
+    // next free slot of the frame, slots of closed blocks are reused by their siblings
+    int nextSlot = 0;
+
+    // scopes below this index belong to enclosing functions
+    size_t frameScopes = 0;
+
+    bool inFunction = false;
+    FunctionKind functionKind = FunctionKind::Function;
+
+    // innermost class being resolved, for 'this' and 'super'
+    ClassStmt *currentClass = nullptr;
+
+    // innermost function being resolved, null at the top level
+    FunStmt *currentFunction = nullptr;
+
+    // innermost loop of the function being resolved, and its cache entry for each global
+    WhileStmt *currentLoop = nullptr;
+    std::unordered_map<std::string, int> loopGlobals;
+
+    bool failed = false;
+
+    void error(const Token& token, const std::string& message) {
+        failed = true;
+        Errors::error(token, message);
+    }
+
+    void resolve(Expr *expr) {
+        expr->accept(this);
+    }
+
+    void resolve(Stmt *stmt) {
+        if (stmt) stmt->accept(this);
+    }
+
+    int declare(Token name) {
+        if (scopes.empty()) return -1;
+
+        auto &scope = scopes.back();
+        if (scope.find(name.lexeme) != scope.end()) {
+            error(name, "Already a variable with this name in this scope");
+        }
+
+        int slot = nextSlot++;
+        scope.insert_or_assign(name.lexeme, Local{ slot, false });
+        return slot;
+    }
+
+    void define(Token name) {
+        if (scopes.empty()) return;
+        scopes.back()[name.lexeme].defined = true;
+    }
+
+    int lookup(Token name) {
+        for (size_t i = scopes.size(); i-- > 0; ) {
+            auto it = scopes[i].find(name.lexeme);
+            if (it == scopes[i].end()) continue;
+
+            if (i < frameScopes) {
+                error(name, "Can't capture local variable of an enclosing function");
+                return -1;
+            }
+
+            return it->second.slot;
+        }
+
+        return -1;
+    }
+
+    // the loop cache entry of a global, -1 for locals and outside of loops.
+    // Also notes the global as one the function mentions
+    int cache(const Token& name, int slot) {
+        if (slot < 0 && currentFunction) currentFunction->globals.push_back(name.lexeme);
+        if (slot >= 0 || !currentLoop) return -1;
+
+        auto [it, added] = loopGlobals.try_emplace(name.lexeme, currentLoop->globals);
+        if (added) currentLoop->globals++;
+        return it->second;
+    }
+
+    // string literal map keys are interned once here instead of on every lookup
+    const Symbol* literalKey(Expr *index) {
+        auto literal = dynamic_cast<LiteralExpr*>(index);
+        if (!literal || literal->value.type() != typeid(std::string)) return nullptr;
+
+        return Symbols::intern(std::any_cast<std::string>(literal->value));
+    }
+
+    void resolveFunction(FunStmt *function) {
+        int enclosingSlot = nextSlot;
+        size_t enclosingFrame = frameScopes;
+        bool enclosingFunction = inFunction;
+        FunctionKind enclosingKind = functionKind;
+        WhileStmt *enclosingLoop = currentLoop;
+        std::unordered_map<std::string, int> enclosingGlobals = std::move(loopGlobals);
+        FunStmt *enclosingDeclaration = currentFunction;
+
+        nextSlot = 0;
+        frameScopes = scopes.size();
+        inFunction = true;
+        functionKind = function->kind;
+        currentFunction = function;
+        function->globals.clear();
+        // the body runs in a frame of its own, outside of the loop's cache
+        currentLoop = nullptr;
+        loopGlobals.clear();
+
+        scopes.emplace_back();
+        if (function->kind != FunctionKind::Function) {
+            scopes.back()["this"] = Local{ nextSlot++, true };
+        }
+
+        for (auto &param : function->params) {
+            declare(param);
+            define(param);
+        }
+
+        // errors the Parser found in a body it only skimmed
+        if (function->lazy) {
+            for (auto &[token, message] : function->lazy->errors) error(token, message);
+        }
+
+        resolve(function->body);
+        function->slotCount = nextSlot;
+        scopes.pop_back();
+
+        auto &globals = function->globals;
+        std::sort(globals.begin(), globals.end());
+        globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+
+        // the enclosing function can hand this one out, and with it what it mentions
+        if (enclosingDeclaration) {
+            enclosingDeclaration->globals.insert(enclosingDeclaration->globals.end(), globals.begin(), globals.end());
+        }
+
+        nextSlot = enclosingSlot;
+        frameScopes = enclosingFrame;
+        inFunction = enclosingFunction;
+        functionKind = enclosingKind;
+        currentLoop = enclosingLoop;
+        loopGlobals = std::move(enclosingGlobals);
+        currentFunction = enclosingDeclaration;
+    }
+
+public:
+    void resolve(const std::vector<Stmt*>& statements) {
+        for (auto stmt : statements) resolve(stmt);
+    }
+
+    // a function on its own, for bodies parsed after the rest of the program.
+    // Only top level functions are parsed late, so there is nothing enclosing
+    // it to resolve against
+    void resolve(FunStmt *function) {
+        resolveFunction(function);
+    }
+
+    bool hadError() const {
+        return failed;
+    }
+
+    /* Expressions */
+
+    std::any visitBinaryExpr(BinaryExpr *expr) override {
+        resolve(expr->left);
+        resolve(expr->right);
+        return nullptr;
+    }
+
+    std::any visitGroupingExpr(GroupingExpr *expr) override {
+        resolve(expr->expression);
+        return nullptr;
+    }
+
+    std::any visitLiteralExpr(LiteralExpr *) override {
+        return nullptr;
+    }
+
+    std::any visitUnaryExpr(UnaryExpr *expr) override {
+        resolve(expr->right);
+        return nullptr;
+    }
+
+    std::any visitVariableExpr(VariableExpr *expr) override {
+        if (!scopes.empty()) {
+            auto &scope = scopes.back();
+            if (auto it = scope.find(expr->name.lexeme); it != scope.end() && !it->second.defined) {
+                error(expr->name, "Can't read local variable in its own initializer");
+            }
+        }
+
+        expr->slot = lookup(expr->name);
+        expr->cache = cache(expr->name, expr->slot);
+        return nullptr;
+    }
+
+    std::any visitAssignExpr(AssignExpr *expr) override {
+        resolve(expr->value);
+        expr->slot = lookup(expr->name);
+        expr->cache = cache(expr->name, expr->slot);
+        return nullptr;
+    }
+
+    std::any visitCallExpr(CallExpr *expr) override {
+        resolve(expr->callee);
+        for (auto arg : expr->arguments) resolve(arg);
+
+        expr->property = dynamic_cast<GetExpr*>(expr->callee);
+        expr->superMethod = dynamic_cast<SuperExpr*>(expr->callee);
+        return nullptr;
+    }
+
+    std::any visitGetExpr(GetExpr *expr) override {
+        resolve(expr->object);
+        return nullptr;
+    }
+
+    std::any visitSetExpr(SetExpr *expr) override {
+        resolve(expr->value);
+        resolve(expr->object);
+        return nullptr;
+    }
+
+    std::any visitThisExpr(ThisExpr *expr) override {
+        if (!currentClass) {
+            error(expr->keyword.token(), "Can't use 'this' outside of a class");
+            return nullptr;
+        }
+
+        expr->slot = lookup(expr->keyword.token());
+        return nullptr;
+    }
+
+    std::any visitSuperExpr(SuperExpr *expr) override {
+        if (!currentClass) {
+            error(expr->keyword.token(), "Can't use 'super' outside of a class");
+        } else if (!currentClass->superclass) {
+            error(expr->keyword.token(), "Can't use 'super' in a class with no superclass");
+        } else {
+            expr->slot = lookup(Token(TokenType::THIS, "this", "", expr->keyword.line));
+        }
+
+        return nullptr;
+    }
+
+    std::any visitArrayExpr(ArrayExpr *expr) override {
+        for (auto element : expr->elements) resolve(element);
+        return nullptr;
+    }
+
+    std::any visitIndexExpr(IndexExpr *expr) override {
+        resolve(expr->object);
+        resolve(expr->index);
+        expr->key = literalKey(expr->index);
+        return nullptr;
+    }
+
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override {
+        resolve(expr->object);
+        resolve(expr->index);
+        resolve(expr->value);
+        expr->key = literalKey(expr->index);
+        return nullptr;
+    }
+
+    std::any visitSpawnExpr(SpawnExpr *expr) override {
+        resolve(expr->call);
+        return nullptr;
+    }
+
+    std::any visitAwaitExpr(AwaitExpr *expr) override {
+        resolve(expr->task);
+        return nullptr;
+    }
+
+    // fused nodes are made after resolving, these only keep the visitor complete
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override {
+        expr->slot = lookup(expr->name);
+        expr->cache = cache(expr->name, expr->slot);
+        return nullptr;
+    }
+
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override {
+        expr->slot = lookup(expr->name);
+        expr->cache = cache(expr->name, expr->slot);
+        return nullptr;
+    }
+
+    std::any visitVarVarExpr(VarVarExpr *expr) override {
+        expr->leftSlot = lookup(expr->left);
+        expr->rightSlot = lookup(expr->right);
+        expr->leftCache = cache(expr->left, expr->leftSlot);
+        expr->rightCache = cache(expr->right, expr->rightSlot);
+        return nullptr;
+    }
+
+    /* Statements */
+
+    void visitExpressionStmt(ExpressionStmt *stmt) override {
+        resolve(stmt->expression);
+    }
+
+    void visitPrintStmt(PrintStmt *stmt) override {
+        resolve(stmt->expression);
+    }
+
+    void visitVarStmt(VarStmt *stmt) override {
+        stmt->slot = declare(stmt->name);
+        if (stmt->initializer) resolve(stmt->initializer);
+        define(stmt->name);
+    }
+
+    void visitFunStmt(FunStmt *stmt) override {
+        // defined before the body so the function can call itself
+        stmt->slot = declare(stmt->name);
+        define(stmt->name);
+
+        resolveFunction(stmt);
+    }
+
+    void visitReturnStmt(ReturnStmt *stmt) override {
+        if (!inFunction) error(stmt->keyword.token(), "Can't return from top-level code");
+
+        if (stmt->value) {
+            if (functionKind == FunctionKind::Initializer) {
+                error(stmt->keyword.token(), "Can't return a value from an initializer");
+            }
+
+            resolve(stmt->value);
+
+            // method calls keep their own fast path and are not turned into tail calls
+            auto call = dynamic_cast<CallExpr*>(stmt->value);
+            stmt->tailCall = call && !dynamic_cast<GetExpr*>(call->callee) && !dynamic_cast<SuperExpr*>(call->callee);
+        }
+    }
+
+    void visitClassStmt(ClassStmt *stmt) override {
+        ClassStmt *enclosingClass = currentClass;
+        currentClass = stmt;
+
+        stmt->slot = declare(stmt->name);
+        define(stmt->name);
+
+        if (stmt->superclass) {
+            if (stmt->superclass->name.lexeme == stmt->name.lexeme) {
+                error(stmt->superclass->name, "A class can't inherit from itself");
+            }
+            resolve(stmt->superclass);
+        }
+
+        for (auto method : stmt->methods) resolveFunction(method);
+
+        currentClass = enclosingClass;
+    }
+
+    void visitIfStmt(IfStmt *stmt) override {
+        resolve(stmt->condition);
+        resolve(stmt->thenBranch);
+        resolve(stmt->elseBranch);
+    }
+
+    void visitWhileStmt(WhileStmt *stmt) override {
+        WhileStmt *enclosingLoop = currentLoop;
+        std::unordered_map<std::string, int> enclosingGlobals = std::move(loopGlobals);
+        currentLoop = stmt;
+        loopGlobals.clear();
+
+        resolve(stmt->condition);
+        resolve(stmt->body);
+        if (stmt->increment) resolve(stmt->increment);
+
+        currentLoop = enclosingLoop;
+        loopGlobals = std::move(enclosingGlobals);
+    }
+
+    void visitBlockStmt(BlockStmt *stmt) override {
+        scopes.emplace_back();
+        stmt->slotStart = nextSlot;
+
+        resolve(stmt->statements);
+
+        stmt->slotCount = nextSlot - stmt->slotStart;
+        nextSlot = stmt->slotStart;
+        scopes.pop_back();
+    }
+};
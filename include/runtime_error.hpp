@@ -3,14 +3,20 @@
 #include <stdexcept>
 
 #include "tokens.hpp"
+#include "stats.hpp"
 
 class RuntimeError : public std::runtime_error {
 public:
-    Token token;
+    int line;
     std::string message;
 
-    RuntimeError(Token token, std::string message) 
-    : runtime_error(message), token(token) { }
+    // a Token converts to a Mark, so errors can be raised at either
+    RuntimeError(Mark where, std::string message) 
+    : runtime_error(message), line(where.line) { HD_STAT(runtimeErrors); }
+
+    // for errors raised between nodes, such as running out of fuel
+    RuntimeError(int line, std::string message)
+    : runtime_error(message), line(line) { HD_STAT(runtimeErrors); }
 
 //     const char* what() const noexcept override {
 //         return message.c_str();
@@ -2,43 +2,60 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <map>
 #include <algorithm>
 
 #include "tokens.hpp"
 #include "errors.hpp"
+#include "stats.hpp"
 
+// the keyword table comes from ast.def
 std::map<std::string, TokenType> getKeywords() {
-    static std::map<std::string, TokenType> keywords;
-
-    keywords.insert( std::make_pair("and",    TokenType::AND)    );                    
-    keywords.insert( std::make_pair("class",  TokenType::CLASS)  );                    
-    keywords.insert( std::make_pair("else",   TokenType::ELSE)   );                    
-    keywords.insert( std::make_pair("false",  TokenType::FALSE)  );                    
-    keywords.insert( std::make_pair("for",    TokenType::FOR)    );                    
-    keywords.insert( std::make_pair("fun",    TokenType::FUN)    );                    
-    keywords.insert( std::make_pair("if",     TokenType::IF)     );                    
-    keywords.insert( std::make_pair("nil",    TokenType::NIL)    );                    
-    keywords.insert( std::make_pair("or",     TokenType::OR)     );                    
-    keywords.insert( std::make_pair("print",  TokenType::PRINT)  );                    
-    keywords.insert( std::make_pair("return", TokenType::RETURN) );                    
-    keywords.insert( std::make_pair("super",  TokenType::SUPER)  );                    
-    keywords.insert( std::make_pair("this",   TokenType::THIS)   );                    
-    keywords.insert( std::make_pair("true",   TokenType::TRUE)   );                    
-    keywords.insert( std::make_pair("var",    TokenType::VAR)    );                    
-    keywords.insert( std::make_pair("while",  TokenType::WHILE)  );
+    std::map<std::string, TokenType> keywords;
+
+    for (auto &keyword : KEYWORDS) keywords.emplace(keyword.text, keyword.type);
 
     return keywords;
 }
 
 class Scanner {
-    std::string source;
+    friend class ParallelScanner;
+
+    // not owned, the text has to outlive the scanner
+    std::string_view source;
     std::vector<Token> tokens;
 
     static const inline std::map<std::string, TokenType> keywords = getKeywords();
 
     size_t start = 0, current = 0, line = 1;
 
+    // line of the first error, 0 while there is none
+    int errorLine = 0;
+    bool finished = false;
+
+    // the ParallelScanner holds errors back until it knows which of them
+    // count, and leaves a string still open at the end of a chunk to itself
+    bool deferErrors = false;
+    bool partial = false;
+    std::vector<std::pair<int, std::string>> deferred;
+    size_t openString = std::string_view::npos, openLine = 0;
+
+    void error(const std::string& message) {
+        if (!errorLine) errorLine = line;
+
+        if (deferErrors) deferred.emplace_back(line, message);
+        else Errors::error(line, message);
+    }
+
+    void scanRest() {
+        while (!isAtEnd()) {
+            start = current;
+            scanToken();
+        }
+    }
+
     bool isAtEnd() {
         return current >= source.length();
     }
@@ -53,7 +70,7 @@ class Scanner {
     }           
 
     void addToken(TokenType type, const std::string& literal) {
-        std::string text = source.substr(start, current-start);      
+        std::string text(source.substr(start, current-start));
         tokens.push_back(Token(type, text, literal, line));
     }
 
@@ -66,6 +83,8 @@ class Scanner {
             case ')': addToken(TokenType::RIGHT_PAREN  ); break;    
             case '{': addToken(TokenType::LEFT_BRACE   ); break;     
             case '}': addToken(TokenType::RIGHT_BRACE  ); break;    
+            case '[': addToken(TokenType::LEFT_BRACKET ); break;
+            case ']': addToken(TokenType::RIGHT_BRACKET); break;
             case ',': addToken(TokenType::COMMA        ); break;          
             case '.': addToken(TokenType::DOT          ); break;            
             case '-': addToken(TokenType::MINUS        ); break;          
@@ -110,7 +129,7 @@ class Scanner {
                 } else if (isAlpha(c)) {
                     identifier();
                 } else {
-                    Errors::error(line, "Unexpected character");
+                    error("Unexpected character");
                 }
             break;
         }
@@ -120,7 +139,7 @@ class Scanner {
         while (isAlphaNumeric(peek())) 
             advance();
 
-        std::string text = source.substr(start, current - start);
+        std::string text(source.substr(start, current - start));
 
         TokenType type;
 
@@ -162,7 +181,7 @@ class Scanner {
             while (isDigit(peek())) advance();
         }
 
-        addToken(TokenType::NUMBER, source.substr(start, current - start));
+        addToken(TokenType::NUMBER, std::string(source.substr(start, current - start)));
     }
 
     char peekNext() {
@@ -173,6 +192,8 @@ class Scanner {
     }
 
     void string() {
+        size_t opened = line;
+
         while (peek() != '"' && !isAtEnd()) {
             if (peek() == '\n')
                 line++;
@@ -182,7 +203,13 @@ class Scanner {
 
         // if string i untermianted
         if (isAtEnd()) {
-            Errors::error(line, "Unterminated string");
+            if (partial) {
+                openString = start;
+                openLine = opened;
+                return;
+            }
+
+            error("Unterminated string");
             return;
         }
 
@@ -190,7 +217,7 @@ class Scanner {
         advance();
 
         // trim double qoutes
-        std::string value = source.substr(start + 1, current - start - 2);
+        std::string value(source.substr(start + 1, current - start - 2));
         addToken(TokenType::STRING, value);
     }
 
@@ -211,17 +238,41 @@ class Scanner {
 
     public:
 
-    Scanner(const std::string& source)
-    : source(source) { }
+    Scanner(std::string_view source, size_t line = 1)
+    : source(source), line(line) { }
     
     std::vector<Token> scanTokens() {
-        while (!isAtEnd()){
+        scanRest();
+
+        tokens.push_back(Token(TokenType::EndOfFile, "", "", line));
+        HD_STAT_ADD(tokensScanned, tokens.size());
+        return tokens;
+    }
+
+    // the next count or so tokens, for pipelined runs. The last batch ends
+    // with EndOfFile, false once it was handed out
+    bool scanBatch(std::vector<Token>& batch, size_t count) {
+        if (finished) return false;
+
+        tokens.clear();
+        tokens.reserve(count + 1);
+        while (!isAtEnd() && tokens.size() < count) {
             start = current;
             scanToken();
         }
 
-        tokens.push_back(Token(TokenType::EndOfFile, "", "", line));
-        return tokens;
+        if (isAtEnd()) {
+            tokens.push_back(Token(TokenType::EndOfFile, "", "", line));
+            finished = true;
+        }
+
+        HD_STAT_ADD(tokensScanned, tokens.size());
+        batch = std::move(tokens);
+        return true;
+    }
+
+    int firstErrorLine() const {
+        return errorLine;
     }
 
 };
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+  Bulk kernels over contiguous doubles, used by the array builtins. With
+  AVX the loops run four lanes at a time, with SSE2 (always there on
+  x86-64) two, and everywhere else they fall back to plain loops. Sums are
+  accumulated per lane, so their rounding can differ from a left to right
+  scalar sum in the last bits.
+*/
+namespace simd {
+
+inline double sum(const double *a, size_t n) {
+    size_t i = 0;
+    double result = 0;
+
+#if defined(__AVX__)
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4) acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+    __m128d acc = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) acc = _mm_add_pd(acc, _mm_loadu_pd(a + i));
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    result = lanes[0] + lanes[1];
+#endif
+
+    for (; i < n; i++) result += a[i];
+    return result;
+}
+
+inline double dot(const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    double result = 0;
+
+#if defined(__AVX__)
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+    __m128d acc = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    result = lanes[0] + lanes[1];
+#endif
+
+    for (; i < n; i++) result += a[i] * b[i];
+    return result;
+}
+
+// callers make sure n > 0. Any NaN in the array makes the result NaN, on
+// every path: _mm*_min_pd and std::min alone would each depend on where it is
+inline double min(const double *a, size_t n) {
+    size_t i = 0;
+    double result = std::numeric_limits<double>::infinity();
+
+#if defined(__AVX__)
+    if (n >= 4) {
+        __m256d acc = _mm256_loadu_pd(a);
+        __m256d nan = _mm256_cmp_pd(acc, acc, _CMP_UNORD_Q);
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_loadu_pd(a + i);
+            acc = _mm256_min_pd(acc, x);
+            nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        }
+        if (_mm256_movemask_pd(nan)) return std::numeric_limits<double>::quiet_NaN();
+
+        double lanes[4];
+        _mm256_storeu_pd(lanes, acc);
+        result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    }
+#elif defined(__SSE2__)
+    if (n >= 2) {
+        __m128d acc = _mm_loadu_pd(a);
+        __m128d nan = _mm_cmpunord_pd(acc, acc);
+        for (i = 2; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(a + i);
+            acc = _mm_min_pd(acc, x);
+            nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+        }
+        if (_mm_movemask_pd(nan)) return std::numeric_limits<double>::quiet_NaN();
+
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        result = std::min(lanes[0], lanes[1]);
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (std::isnan(a[i])) return std::numeric_limits<double>::quiet_NaN();
+        result = std::min(result, a[i]);
+    }
+    return result;
+}
+
+inline double max(const double *a, size_t n) {
+    size_t i = 0;
+    double result = -std::numeric_limits<double>::infinity();
+
+#if defined(__AVX__)
+    if (n >= 4) {
+        __m256d acc = _mm256_loadu_pd(a);
+        __m256d nan = _mm256_cmp_pd(acc, acc, _CMP_UNORD_Q);
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_loadu_pd(a + i);
+            acc = _mm256_max_pd(acc, x);
+            nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        }
+        if (_mm256_movemask_pd(nan)) return std::numeric_limits<double>::quiet_NaN();
+
+        double lanes[4];
+        _mm256_storeu_pd(lanes, acc);
+        result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    }
+#elif defined(__SSE2__)
+    if (n >= 2) {
+        __m128d acc = _mm_loadu_pd(a);
+        __m128d nan = _mm_cmpunord_pd(acc, acc);
+        for (i = 2; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(a + i);
+            acc = _mm_max_pd(acc, x);
+            nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+        }
+        if (_mm_movemask_pd(nan)) return std::numeric_limits<double>::quiet_NaN();
+
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        result = std::max(lanes[0], lanes[1]);
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (std::isnan(a[i])) return std::numeric_limits<double>::quiet_NaN();
+        result = std::max(result, a[i]);
+    }
+    return result;
+}
+
+// out[i] = a[i] * k, out may alias a
+inline void scale(double *out, const double *a, double k, size_t n) {
+    size_t i = 0;
+
+#if defined(__AVX__)
+    __m256d factor = _mm256_set1_pd(k);
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factor));
+#elif defined(__SSE2__)
+    __m128d factor = _mm_set1_pd(k);
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), factor));
+#endif
+
+    for (; i < n; i++) out[i] = a[i] * k;
+}
+
+inline void add(double *out, const double *a, const double *b, size_t n) {
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+
+    for (; i < n; i++) out[i] = a[i] + b[i];
+}
+
+inline void mul(double *out, const double *a, const double *b, size_t n) {
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+
+    for (; i < n; i++) out[i] = a[i] * b[i];
+}
+
+// no portable SIMD sort, std::sort on the unboxed doubles is what we get.
+// NaN breaks the ordering std::sort needs, so NaNs are moved to the end first
+inline void sort(double *a, size_t n) {
+    double *numbers = std::partition(a, a + n, [](double x) { return !std::isnan(x); });
+    std::sort(a, numbers);
+}
+
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+  Bounded queue between two threads, one pushing and one popping, for the
+  stages of a pipelined run. A ring of slots with one index per side: only
+  the producer writes tail and only the consumer writes head, each reads the
+  other's index with acquire ordering, so no locks are needed. A side that
+  finds the queue full or empty yields for a while, and if the other side
+  still hasn't caught up it goes to sleep on a condition variable rather than
+  spin for as long as, say, one slow statement runs. The lock is only taken
+  to sleep, or to wake a side that is asleep.
+
+  The producer closes the queue when it is done and the consumer drains what
+  is left before it sees the end. Either side can cancel, after which every
+  push and pop fails so both stages stop early; what is still queued can be
+  taken out with tryPop.
+*/
+template <typename T>
+class SpscQueue {
+    std::vector<T> slots;
+    size_t mask;
+
+    // on separate cache lines, each is written by one thread and only read by the other
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    alignas(64) std::atomic<bool> closed{ false };
+    std::atomic<bool> cancelled{ false };
+
+    // yields before a side goes to sleep
+    static constexpr int SPINS = 64;
+
+    std::mutex sleepLock;
+    std::condition_variable wakeup;
+    std::atomic<int> sleepers{ 0 };
+
+    bool full() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == slots.size();
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+    // returns once ready() holds, spinning first and then asleep
+    template <typename Ready>
+    void await(Ready ready) {
+        for (int spin = 0; spin < SPINS; spin++) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> guard(sleepLock);
+        sleepers.fetch_add(1);
+        // pairs with the fence in wake(): either ready() sees the change or wake() sees the sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wakeup.wait(guard, ready);
+        sleepers.fetch_sub(1);
+    }
+
+    // after a push, pop, close or cancel, for a side that may be asleep
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) == 0) return;
+
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wakeup.notify_all();
+    }
+
+public:
+    // the capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool tryPush(T& value) {
+        size_t end = tail.load(std::memory_order_relaxed);
+        if (end - head.load(std::memory_order_acquire) == slots.size()) return false;
+
+        slots[end & mask] = std::move(value);
+        tail.store(end + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t start = head.load(std::memory_order_relaxed);
+        if (start == tail.load(std::memory_order_acquire)) return false;
+
+        value = std::move(slots[start & mask]);
+        head.store(start + 1, std::memory_order_release);
+        return true;
+    }
+
+    // false once the queue is cancelled, the value is left with the caller then
+    bool push(T& value) {
+        while (!cancelled.load(std::memory_order_acquire)) {
+            if (tryPush(value)) {
+                wake();
+                return true;
+            }
+
+            await([this] { return cancelled.load(std::memory_order_acquire) || !full(); });
+        }
+
+        return false;
+    }
+
+    // false at the end: closed and drained, or cancelled
+    bool pop(T& value) {
+        while (!cancelled.load(std::memory_order_acquire)) {
+            if (tryPop(value)) {
+                wake();
+                return true;
+            }
+
+            // whatever was pushed before the close is visible now
+            if (closed.load(std::memory_order_acquire)) return tryPop(value);
+
+            await([this] {
+                return cancelled.load(std::memory_order_acquire) || closed.load(std::memory_order_acquire) || !empty();
+            });
+        }
+
+        return false;
+    }
+
+    void close() {
+        closed.store(true, std::memory_order_release);
+        wake();
+    }
+
+    void cancel() {
+        cancelled.store(true, std::memory_order_release);
+        wake();
+    }
+};
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+
+#include "heap.hpp"
+#include "phase.hpp"
+
+/*
+  Internal telemetry for hd --stats. The counters are bumped through the
+  HD_STAT macros, which expand to nothing unless HD_STATS is 1, so release
+  builds carry no instrumentation at all. Phase timings are always kept,
+  they cost a couple of clock reads per run.
+
+  Counters are per thread. Task workers fold theirs into a shared total
+  when they exit, and the reports show this thread's counters plus that
+  total.
+*/
+
+#ifndef HD_STATS
+#ifdef NDEBUG
+#define HD_STATS 0
+#else
+#define HD_STATS 1
+#endif
+#endif
+
+#if HD_STATS
+#define HD_STAT(counter) (Stats::counters.counter++)
+#define HD_STAT_ADD(counter, n) (Stats::counters.counter += (n))
+#else
+#define HD_STAT(counter) ((void) 0)
+#define HD_STAT_ADD(counter, n) ((void) 0)
+#endif
+
+// allocations outside of any phase (startup, reporting) are booked here
+constexpr int PHASE_SLOTS = static_cast<int>(Phase::__COUNT) + 1;
+
+struct Counters {
+    uint64_t tokensScanned = 0;
+    uint64_t exprNodes = 0;
+    uint64_t stmtNodes = 0;
+    // function bodies the Parser skimmed, and how many of them were parsed on a call
+    uint64_t lazyFunctions = 0;
+    uint64_t lazyParses = 0;
+
+    uint64_t allocations[PHASE_SLOTS] = {};
+    uint64_t bytesAllocated[PHASE_SLOTS] = {};
+
+    uint64_t environmentGets = 0;
+    uint64_t environmentAssigns = 0;
+    uint64_t environmentDefines = 0;
+    // globals copied out of the shared prelude because they were written
+    uint64_t preludeCopies = 0;
+    uint64_t hashLookups = 0;
+    // entries of the buckets the lookups landed in
+    uint64_t hashProbes = 0;
+
+    uint64_t anyCopies = 0;
+    uint64_t anyCasts = 0;
+
+    uint64_t functionCalls = 0;
+    uint64_t tailCalls = 0;
+    uint64_t integerOps = 0;
+    // integer results that left the exact range and were redone in double
+    uint64_t integerPromotions = 0;
+    // operators whose operand types the TypeChecker proved, and how often they ran without checks
+    uint64_t typedSites = 0;
+    uint64_t uncheckedOps = 0;
+    // sites the Fuser rewrote into superinstructions
+    uint64_t fusedCompoundAssigns = 0;
+    uint64_t fusedVarLiterals = 0;
+    uint64_t fusedVarVars = 0;
+    // statements the DeadCodeEliminator removed or cut down to their initializer
+    uint64_t deadStatements = 0;
+    uint64_t nativeCalls = 0;
+    // native calls that went straight to a number to number function
+    uint64_t nativeDirectCalls = 0;
+    // global uses a loop's cache answered without hashing the name
+    uint64_t cachedGlobals = 0;
+    // if and loop conditions decided straight from a comparison's operands
+    uint64_t fastConditions = 0;
+
+    uint64_t shapesCreated = 0;
+    uint64_t inlineCacheHits = 0;
+    uint64_t inlineCacheMisses = 0;
+
+    uint64_t mapLookups = 0;
+    // slots looked at by those lookups, and the most a single one looked at
+    uint64_t mapProbes = 0;
+    uint64_t mapLongestProbe = 0;
+    // load factor of the table at each lookup, in thousandths
+    uint64_t mapLoadMillis = 0;
+    uint64_t mapGrows = 0;
+    uint64_t symbolsInterned = 0;
+    uint64_t symbolsFreed = 0;
+    uint64_t internedKeyHits = 0;
+
+    uint64_t tasksSpawned = 0;
+
+    uint64_t runtimeErrors = 0;
+
+    double phaseNs[PHASE_SLOTS] = {};
+
+    void add(const Counters& other) {
+        tokensScanned += other.tokensScanned;
+        exprNodes += other.exprNodes;
+        stmtNodes += other.stmtNodes;
+        lazyFunctions += other.lazyFunctions;
+        lazyParses += other.lazyParses;
+
+        for (int slot = 0; slot < PHASE_SLOTS; slot++) {
+            allocations[slot] += other.allocations[slot];
+            bytesAllocated[slot] += other.bytesAllocated[slot];
+            phaseNs[slot] += other.phaseNs[slot];
+        }
+
+        environmentGets += other.environmentGets;
+        environmentAssigns += other.environmentAssigns;
+        environmentDefines += other.environmentDefines;
+        preludeCopies += other.preludeCopies;
+        hashLookups += other.hashLookups;
+        hashProbes += other.hashProbes;
+        anyCopies += other.anyCopies;
+        anyCasts += other.anyCasts;
+        functionCalls += other.functionCalls;
+        tailCalls += other.tailCalls;
+        integerOps += other.integerOps;
+        integerPromotions += other.integerPromotions;
+        typedSites += other.typedSites;
+        uncheckedOps += other.uncheckedOps;
+        fusedCompoundAssigns += other.fusedCompoundAssigns;
+        fusedVarLiterals += other.fusedVarLiterals;
+        fusedVarVars += other.fusedVarVars;
+        deadStatements += other.deadStatements;
+        nativeCalls += other.nativeCalls;
+        nativeDirectCalls += other.nativeDirectCalls;
+        cachedGlobals += other.cachedGlobals;
+        fastConditions += other.fastConditions;
+        shapesCreated += other.shapesCreated;
+        inlineCacheHits += other.inlineCacheHits;
+        inlineCacheMisses += other.inlineCacheMisses;
+        mapLookups += other.mapLookups;
+        mapProbes += other.mapProbes;
+        if (other.mapLongestProbe > mapLongestProbe) mapLongestProbe = other.mapLongestProbe;
+        mapLoadMillis += other.mapLoadMillis;
+        mapGrows += other.mapGrows;
+        symbolsInterned += other.symbolsInterned;
+        symbolsFreed += other.symbolsFreed;
+        internedKeyHits += other.internedKeyHits;
+        tasksSpawned += other.tasksSpawned;
+        runtimeErrors += other.runtimeErrors;
+    }
+};
+
+class Stats {
+    using Clock = std::chrono::steady_clock;
+
+public:
+    static inline thread_local Counters counters;
+    static inline thread_local int phase = static_cast<int>(Phase::__COUNT);
+
+    // counters of threads that have finished
+    static inline Counters finished;
+    static inline std::mutex finishedLock;
+
+    static void flushThread() {
+        std::lock_guard<std::mutex> guard(finishedLock);
+        finished.add(counters);
+        counters = Counters();
+    }
+
+    static Counters total() {
+        std::lock_guard<std::mutex> guard(finishedLock);
+        Counters sum = counters;
+        sum.add(finished);
+        return sum;
+    }
+
+    // marks the current phase and times it for as long as it is alive
+    class PhaseScope {
+        int previous;
+        Clock::time_point start;
+
+    public:
+        PhaseScope(Phase current) : previous(phase), start(Clock::now()) {
+            phase = static_cast<int>(current);
+        }
+
+        ~PhaseScope() {
+            counters.phaseNs[phase] += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            phase = previous;
+        }
+    };
+
+    static const char* slotName(int slot) {
+        return slot == static_cast<int>(Phase::__COUNT) ? "other" : phaseName(static_cast<Phase>(slot));
+    }
+
+    static void report(std::ostream& out) {
+        const Counters c = total();
+
+        out << "\ninterpreter stats" << (HD_STATS ? "" : " (counters compiled out in this build)") << "\n";
+        out << std::fixed << std::setprecision(3);
+
+        out << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "time ms"
+            << std::setw(14) << "allocations" << std::setw(16) << "bytes" << "\n";
+
+        for (int slot = 0; slot < PHASE_SLOTS; slot++) {
+            out << std::left << std::setw(12) << slotName(slot) << std::right
+                << std::setw(12) << c.phaseNs[slot] / 1e6
+                << std::setw(14) << c.allocations[slot] << std::setw(16) << c.bytesAllocated[slot] << "\n";
+        }
+
+        if (!HD_STATS) return;
+
+        auto row = [&](const char* name, uint64_t value) {
+            out << std::left << std::setw(26) << name << std::right << std::setw(14) << value << "\n";
+        };
+
+        row("tokens scanned", c.tokensScanned);
+        row("expr nodes", c.exprNodes);
+        row("stmt nodes", c.stmtNodes);
+        row("lazy functions", c.lazyFunctions);
+        row("lazy bodies parsed", c.lazyParses);
+        row("environment gets", c.environmentGets);
+        row("environment assigns", c.environmentAssigns);
+        row("environment defines", c.environmentDefines);
+        row("prelude copies", c.preludeCopies);
+        row("hash lookups", c.hashLookups);
+        row("hash probes", c.hashProbes);
+        row("std::any copies", c.anyCopies);
+        row("std::any casts", c.anyCasts);
+        row("function calls", c.functionCalls);
+        row("tail calls", c.tailCalls);
+        row("integer ops", c.integerOps);
+        row("integer promotions", c.integerPromotions);
+        row("typed sites", c.typedSites);
+        row("unchecked ops", c.uncheckedOps);
+        row("fused x = x op k", c.fusedCompoundAssigns);
+        row("fused var op literal", c.fusedVarLiterals);
+        row("fused var op var", c.fusedVarVars);
+        row("dead statements removed", c.deadStatements);
+        row("native calls", c.nativeCalls);
+        row("native direct calls", c.nativeDirectCalls);
+        row("cached global uses", c.cachedGlobals);
+        row("fast conditions", c.fastConditions);
+        row("shapes created", c.shapesCreated);
+        row("inline cache hits", c.inlineCacheHits);
+        row("inline cache misses", c.inlineCacheMisses);
+        row("map lookups", c.mapLookups);
+        row("map probes", c.mapProbes);
+        row("map longest probe", c.mapLongestProbe);
+        row("map grows", c.mapGrows);
+        row("symbols interned", c.symbolsInterned);
+        row("symbols freed", c.symbolsFreed);
+        row("interned key hits", c.internedKeyHits);
+        row("tasks spawned", c.tasksSpawned);
+        row("runtime errors", c.runtimeErrors);
+
+        if (c.mapLookups) {
+            out << std::left << std::setw(26) << "map avg probe length" << std::right << std::setw(14)
+                << static_cast<double>(c.mapProbes) / c.mapLookups << "\n";
+            out << std::left << std::setw(26) << "map avg load factor" << std::right << std::setw(14)
+                << c.mapLoadMillis / 1000.0 / c.mapLookups << "\n";
+        }
+    }
+
+    static void reportJson(std::ostream& out) {
+        const Counters c = total();
+
+        out << "{\n  \"counters_enabled\": " << (HD_STATS ? "true" : "false") << ",\n  \"phases\": {";
+
+        for (int slot = 0; slot < PHASE_SLOTS; slot++) {
+            out << (slot ? ", " : "") << "\"" << slotName(slot) << "\": {"
+                << "\"time_ns\": " << static_cast<uint64_t>(c.phaseNs[slot])
+                << ", \"allocations\": " << c.allocations[slot]
+                << ", \"bytes\": " << c.bytesAllocated[slot] << "}";
+        }
+
+        out << "}";
+
+        if (HD_STATS) {
+            out << ",\n  \"tokens_scanned\": " << c.tokensScanned
+                << ",\n  \"expr_nodes\": " << c.exprNodes
+                << ",\n  \"stmt_nodes\": " << c.stmtNodes
+                << ",\n  \"lazy_functions\": " << c.lazyFunctions
+                << ",\n  \"lazy_parses\": " << c.lazyParses
+                << ",\n  \"environment_gets\": " << c.environmentGets
+                << ",\n  \"environment_assigns\": " << c.environmentAssigns
+                << ",\n  \"environment_defines\": " << c.environmentDefines
+                << ",\n  \"prelude_copies\": " << c.preludeCopies
+                << ",\n  \"hash_lookups\": " << c.hashLookups
+                << ",\n  \"hash_probes\": " << c.hashProbes
+                << ",\n  \"any_copies\": " << c.anyCopies
+                << ",\n  \"any_casts\": " << c.anyCasts
+                << ",\n  \"function_calls\": " << c.functionCalls
+                << ",\n  \"tail_calls\": " << c.tailCalls
+                << ",\n  \"integer_ops\": " << c.integerOps
+                << ",\n  \"integer_promotions\": " << c.integerPromotions
+                << ",\n  \"typed_sites\": " << c.typedSites
+                << ",\n  \"unchecked_ops\": " << c.uncheckedOps
+                << ",\n  \"fused_compound_assigns\": " << c.fusedCompoundAssigns
+                << ",\n  \"fused_var_literals\": " << c.fusedVarLiterals
+                << ",\n  \"fused_var_vars\": " << c.fusedVarVars
+                << ",\n  \"dead_statements\": " << c.deadStatements
+                << ",\n  \"native_calls\": " << c.nativeCalls
+                << ",\n  \"native_direct_calls\": " << c.nativeDirectCalls
+                << ",\n  \"cached_globals\": " << c.cachedGlobals
+                << ",\n  \"fast_conditions\": " << c.fastConditions
+                << ",\n  \"shapes_created\": " << c.shapesCreated
+                << ",\n  \"inline_cache_hits\": " << c.inlineCacheHits
+                << ",\n  \"inline_cache_misses\": " << c.inlineCacheMisses
+                << ",\n  \"map_lookups\": " << c.mapLookups
+                << ",\n  \"map_probes\": " << c.mapProbes
+                << ",\n  \"map_longest_probe\": " << c.mapLongestProbe
+                << ",\n  \"map_load_factor\": " << (c.mapLookups ? c.mapLoadMillis / 1000.0 / c.mapLookups : 0.0)
+                << ",\n  \"map_grows\": " << c.mapGrows
+                << ",\n  \"symbols_interned\": " << c.symbolsInterned
+                << ",\n  \"symbols_freed\": " << c.symbolsFreed
+                << ",\n  \"interned_key_hits\": " << c.internedKeyHits
+                << ",\n  \"tasks_spawned\": " << c.tasksSpawned
+                << ",\n  \"runtime_errors\": " << c.runtimeErrors;
+        }
+
+        out << "\n}\n";
+    }
+};
+
+// allocation hook: every heap allocation is booked against the current
+// phase under HD_STATS, and counted towards the live heap for --max-heap
+
+void* operator new(std::size_t size) {
+#if HD_STATS
+    Stats::counters.allocations[Stats::phase]++;
+    Stats::counters.bytesAllocated[Stats::phase] += size;
+#endif
+
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        Heap::allocated(ptr);
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// kept out of line, otherwise gcc sees malloc'd memory reach free through
+// an inlined delete and warns about mismatched allocation functions
+[[gnu::noinline]] void operator delete(void *ptr) noexcept {
+    Heap::freed(ptr);
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void *ptr, std::size_t) noexcept {
+    Heap::freed(ptr);
+    std::free(ptr);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "stats.hpp"
+
+/*
+  Interned strings used as map keys. Every distinct text held by a map gets
+  exactly one Symbol, so two stored keys are equal when their pointers are,
+  and the hash is computed once when the text is first interned. Lookups
+  don't intern, they hash the text and compare it (see MapKey), so only keys
+  a map actually stores end up here. Each Symbol counts the maps holding it
+  and is freed with the last of them; string literal keys keep theirs for
+  good. Tasks intern keys too, so the table is split in shards, each behind
+  a lock of its own.
+*/
+struct Symbol {
+    std::string text;
+    uint32_t hash;
+    // stored keys and literals referring to it, guarded by the shard's lock
+    mutable size_t refs = 0;
+};
+
+class Symbols {
+    static constexpr size_t SHARDS = 16;
+
+    struct Shard {
+        std::unordered_map<std::string, std::unique_ptr<Symbol>> table;
+        std::mutex lock;
+    };
+
+    static inline Shard shards[SHARDS];
+
+    // maps take the low bits of the hash for their slots, the shard comes from the high ones
+    static Shard& shard(uint32_t hash) {
+        return shards[(hash >> 24) % SHARDS];
+    }
+
+public:
+    static uint32_t hash(const std::string& text) {
+        size_t hash = std::hash<std::string>()(text);
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    // the symbol for text, with a reference the caller gives back through release()
+    static const Symbol* intern(const std::string& text) {
+        uint32_t code = hash(text);
+        Shard &owner = shard(code);
+
+        std::lock_guard<std::mutex> guard(owner.lock);
+        auto &symbol = owner.table[text];
+
+        if (!symbol) {
+            HD_STAT(symbolsInterned);
+            symbol = std::make_unique<Symbol>(Symbol{ text, code });
+        }
+
+        symbol->refs++;
+        return symbol.get();
+    }
+
+    static void retain(const Symbol *symbol) {
+        std::lock_guard<std::mutex> guard(shard(symbol->hash).lock);
+        symbol->refs++;
+    }
+
+    static void release(const Symbol *symbol) {
+        Shard &owner = shard(symbol->hash);
+
+        std::lock_guard<std::mutex> guard(owner.lock);
+        if (--symbol->refs == 0) {
+            HD_STAT(symbolsFreed);
+            owner.table.erase(owner.table.find(symbol->text));
+        }
+    }
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "object.hpp"
+#include "runtime_error.hpp"
+#include "stats.hpp"
+
+// what a spawned task leaves behind for whoever awaits it
+struct TaskState {
+    std::atomic<bool> done{ false };
+    std::mutex lock;
+    std::condition_variable finished;
+
+    // only touched by the worker until done is set, then only by the awaiting thread
+    std::any result;
+    std::optional<RuntimeError> error;
+    std::ostringstream output;
+
+    bool awaited = false;
+
+    void finish() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            done.store(true, std::memory_order_release);
+        }
+        finished.notify_all();
+    }
+};
+
+// the handle a script holds; the state is shared with the worker running the task
+class LoxTask : public Object {
+public:
+    std::shared_ptr<TaskState> state;
+
+    LoxTask(std::shared_ptr<TaskState> state) : state(std::move(state)) {}
+};
+
+/*
+  Work stealing pool behind spawn/await. Every worker thread owns a deque:
+  tasks spawned from a worker go to the back of its own deque and it takes
+  work from the back too, so nested spawns run depth first on the thread
+  that made them. Idle workers steal from the front of the others' deques.
+  Threads outside the pool (the main interpreter) push to a shared deque.
+
+  A thread waiting on a task keeps running queued tasks until the one it
+  waits for is done, so awaiting from inside a task never blocks a worker
+  while there is work left, and the main thread lends a hand as well.
+*/
+class TaskPool {
+public:
+    using Job = std::function<void()>;
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Job> jobs;
+    };
+
+    // queues[0] is fed by threads outside the pool, queues[i + 1] belongs to worker i
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    // jobs pushed and not taken yet, only raised under sleepLock so no wakeup is lost
+    std::atomic<size_t> pending{ 0 };
+    bool stopping = false;
+
+    // the queue of the worker running on this thread, null on threads outside any pool
+    static inline thread_local Queue *local = nullptr;
+
+    // index of the calling worker's queue, 0 on threads outside the pool
+    size_t own() const {
+        for (size_t i = 1; i < queues.size(); i++) {
+            if (queues[i].get() == local) return i;
+        }
+        return 0;
+    }
+
+    bool pop(Queue &queue, Job &job, bool back) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.jobs.empty()) return false;
+
+        if (back) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        } else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+
+        pending--;
+        return true;
+    }
+
+    bool take(Job &job) {
+        size_t mine = own();
+        if (mine && pop(*queues[mine], job, true)) return true;
+
+        // steal the oldest job of someone else, starting after our own queue
+        for (size_t i = 0; i < queues.size(); i++) {
+            size_t victim = (mine + i) % queues.size();
+            if (mine && victim == mine) continue;
+            if (pop(*queues[victim], job, false)) return true;
+        }
+
+        return false;
+    }
+
+    void work(Queue *queue) {
+        local = queue;
+
+        while (true) {
+            Job job;
+            if (take(job)) {
+                job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [&] { return stopping || pending > 0; });
+            if (stopping && pending == 0) break;
+        }
+
+        local = nullptr;
+    }
+
+public:
+    explicit TaskPool(size_t workers) {
+        queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < workers; i++) queues.push_back(std::make_unique<Queue>());
+
+        for (size_t i = 0; i < workers; i++) {
+            Queue *queue = queues[i + 1].get();
+            threads.emplace_back([this, queue] { work(queue); });
+        }
+    }
+
+    // one worker per core, less the thread that spawns and awaits
+    static size_t defaultWorkers() {
+        unsigned cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 1;
+    }
+
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (auto &thread : threads) thread.join();
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    void submit(Job job) {
+        Queue &queue = *queues[own()];
+
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.jobs.push_back(std::move(job));
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // runs other jobs until the task is done
+    void wait(TaskState &state) {
+        while (!state.done.load(std::memory_order_acquire)) {
+            Job job;
+            if (take(job)) {
+                job();
+                continue;
+            }
+
+            // nothing to help with: sleep until the task finishes, looking for work now and then
+            std::unique_lock<std::mutex> guard(state.lock);
+            state.finished.wait_for(guard, std::chrono::milliseconds(1),
+                                    [&] { return state.done.load(std::memory_order_acquire); });
+        }
+    }
+};
@@ -1,57 +1,14 @@
 #pragma once
 
 #include <string>
-#include <any>
-#include <sstream>
-#include <vector>
+#include <ostream>
 
-/*
-  Copied from stack overflow. This macro defines operator << for enum
-*/
-
-#define AWESOME_ENUM(name, ...) enum class name { __VA_ARGS__, __COUNT}; \
-std::string toString(name value) { \
-  std::string enumName = #name; \
-  std::string str = #__VA_ARGS__; \
-  int len = str.length(); \
-  std::vector<std::string> strings; \
-  std::ostringstream temp; \
-  for(int i = 0; i < len; i ++) { \
-    if(isspace(str[i])) continue; \
-    else if(str[i] == ',') { \
-      strings.push_back(temp.str()); \
-      temp.str(std::string());\
-    } \
-    else temp<< str[i]; \
-} \
-strings.push_back(temp.str()); \
-return strings[static_cast<int>(value)]; \
-} \
-inline std::ostream& operator<<(std::ostream& os, name value) { \
- \
-os << #name << "::" << toString(value); \
-return os;} \
-
-AWESOME_ENUM (TokenType,                            
-  // Single-character tokens.                      
-  LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE,
-  COMMA, DOT, MINUS, PLUS, SEMICOLON, SLASH, STAR, 
+// TokenType and its name, spelling and keyword tables are generated from ast.def
+#include "token_type.hpp"
 
-  // One or two character tokens.                  
-  BANG, BANG_EQUAL,                                
-  EQUAL, EQUAL_EQUAL,                              
-  GREATER, GREATER_EQUAL,                          
-  LESS, LESS_EQUAL,                                
-
-  // Literals.                                     
-  IDENTIFIER, STRING, NUMBER,                      
-
-  // Keywords.                                     
-  AND, CLASS, ELSE, FALSE, FUN, FOR, IF, NIL, OR,  
-  PRINT, RETURN, SUPER, THIS, TRUE, VAR, WHILE,    
-
-  EndOfFile                                              
-);
+inline std::ostream& operator<<(std::ostream& os, TokenType value) {
+    return os << "TokenType::" << toString(value);
+}
 
 class Token {
 
@@ -71,4 +28,22 @@ public:
 std::ostream& operator<<(std::ostream& out, Token t) {
     out << t.type << " " << t.lexeme << " " << t.literal;
     return out;
-}
\ No newline at end of file
+}
+
+/*
+  A token cut down to its kind and line, for nodes that only switch on an
+  operator or report errors at a keyword or bracket. Those tokens have a
+  fixed spelling, so the full Token can be rebuilt when an error needs it.
+*/
+struct Mark {
+    TokenType type;
+    int line;
+
+    Mark(const Token& token) : type(token.type), line(token.line) {}
+
+    Mark(TokenType type, int line) : type(type), line(line) {}
+
+    Token token() const {
+        return Token(type, spelling(type), "", line);
+    }
+};
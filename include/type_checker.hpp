@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "stats.hpp"
+
+/*
+  Static pass that runs after the Resolver and proves the operand types of
+  unary and binary operators where it can, so the interpreter skips its
+  type checks there. It walks each function body in execution order and
+  tracks the set of types every frame slot may hold at that point: a 'var'
+  or an assignment sets a slot, the branches of an 'if' are joined, and a
+  'return' ends the path. A loop body is checked again with the types at
+  the end of each trip joined into those at its start, until they stop
+  growing, and then once more to tag its operators for every trip.
+  Functions can't see the locals of an enclosing function, so nothing
+  outside the body can change a slot behind its back.
+
+  Globals, parameters, calls, properties and indexing are never proven,
+  anything could have put any value there.
+*/
+class TypeChecker : public ExprVisitor, public StmtVisitor {
+
+    // a set of the types a value may have
+    using Types = uint8_t;
+
+    static constexpr Types NIL = 1, BOOL = 2, NUMBER = 4, STRING = 8, OTHER = 16;
+    static constexpr Types ANY = NIL | BOOL | NUMBER | STRING | OTHER;
+
+    // types of the current frame's slots, slots past the end may hold anything
+    std::vector<Types> slots;
+
+    // false after a return, until the paths join again
+    bool reachable = true;
+
+    // loops being checked for their fixpoint, tags set meanwhile are redone later
+    int widening = 0;
+
+    Types check(Expr *expr) {
+        return std::any_cast<Types>(expr->accept(this));
+    }
+
+    void check(Stmt *stmt) {
+        if (stmt) stmt->accept(this);
+    }
+
+    Types slot(int index) const {
+        if (index < 0 || static_cast<size_t>(index) >= slots.size()) return ANY;
+        return slots[index];
+    }
+
+    void set(int index, Types types) {
+        if (index < 0) return;
+        if (static_cast<size_t>(index) >= slots.size()) slots.resize(index + 1, ANY);
+        slots[index] = types;
+    }
+
+    // merges the state at the end of another path into the current one
+    void join(const std::vector<Types>& other, bool otherReachable) {
+        if (!otherReachable) return;
+
+        if (!reachable) {
+            slots = other;
+            reachable = true;
+            return;
+        }
+
+        if (other.size() < slots.size()) slots.resize(other.size());
+        for (size_t i = 0; i < slots.size(); i++) slots[i] |= other[i];
+    }
+
+    // every check of a site overwrites its tag, a later trip through a loop may know less
+    void prove(Operands& operands, Operands value) {
+        operands = value;
+        if (value != Operands::Unknown && !widening) HD_STAT(typedSites);
+    }
+
+    static Operands proven(Types left, Types right) {
+        if (left == NUMBER && right == NUMBER) return Operands::Numbers;
+        if (left == STRING && right == STRING) return Operands::Strings;
+        return Operands::Unknown;
+    }
+
+    static Types literal(const std::any& value) {
+        auto &type = value.type();
+
+        if (type == typeid(int64_t) || type == typeid(double)) return NUMBER;
+        if (type == typeid(std::string)) return STRING;
+        if (type == typeid(bool)) return BOOL;
+        return NIL;
+    }
+
+    // tags the operator with what is proven about its operands, returns its result's types
+    Types binary(TokenType Operator, Types left, Types right, Operands& operands) {
+        switch (Operator) {
+            case TokenType::PLUS:
+                prove(operands, proven(left, right));
+                return Types((left & right & NUMBER) | (left & right & STRING));
+
+            case TokenType::EQUAL_EQUAL:
+            case TokenType::BANG_EQUAL:
+                prove(operands, proven(left, right));
+                return BOOL;
+
+            case TokenType::GREATER:
+            case TokenType::GREATER_EQUAL:
+            case TokenType::LESS:
+            case TokenType::LESS_EQUAL:
+                prove(operands, left == NUMBER && right == NUMBER ? Operands::Numbers : Operands::Unknown);
+                return BOOL;
+
+            default:
+                prove(operands, left == NUMBER && right == NUMBER ? Operands::Numbers : Operands::Unknown);
+                return NUMBER;
+        }
+    }
+
+    // one trip around a loop from its condition to the end of the increment
+    void trip(WhileStmt *loop, bool condition = true) {
+        if (condition) check(loop->condition);
+        check(loop->body);
+        if (loop->increment) check(loop->increment);
+    }
+
+    void checkFunction(FunStmt *function) {
+        std::vector<Types> enclosingSlots = std::move(slots);
+        bool enclosingReachable = reachable;
+
+        // 'this' and the parameters can be anything
+        slots.clear();
+        reachable = true;
+        for (auto stmt : function->body) check(stmt);
+
+        slots = std::move(enclosingSlots);
+        reachable = enclosingReachable;
+    }
+
+public:
+    void check(const std::vector<Stmt*>& statements) {
+        for (auto stmt : statements) check(stmt);
+    }
+
+    void check(FunStmt *function) {
+        checkFunction(function);
+    }
+
+    /* Expressions */
+
+    std::any visitBinaryExpr(BinaryExpr *expr) override {
+        Types left = check(expr->left);
+        Types right = check(expr->right);
+        return binary(expr->Operator.type, left, right, expr->operands);
+    }
+
+    std::any visitGroupingExpr(GroupingExpr *expr) override {
+        return check(expr->expression);
+    }
+
+    std::any visitLiteralExpr(LiteralExpr *expr) override {
+        return literal(expr->value);
+    }
+
+    std::any visitUnaryExpr(UnaryExpr *expr) override {
+        Types right = check(expr->right);
+
+        if (expr->Operator.type == TokenType::BANG) return BOOL;
+
+        prove(expr->operands, right == NUMBER ? Operands::Numbers : Operands::Unknown);
+        return NUMBER;
+    }
+
+    std::any visitVariableExpr(VariableExpr *expr) override {
+        return slot(expr->slot);
+    }
+
+    std::any visitAssignExpr(AssignExpr *expr) override {
+        Types value = check(expr->value);
+        set(expr->slot, value);
+        return value;
+    }
+
+    std::any visitCallExpr(CallExpr *expr) override {
+        check(expr->callee);
+        for (auto arg : expr->arguments) check(arg);
+        return ANY;
+    }
+
+    std::any visitGetExpr(GetExpr *expr) override {
+        check(expr->object);
+        return ANY;
+    }
+
+    std::any visitSetExpr(SetExpr *expr) override {
+        Types value = check(expr->value);
+        check(expr->object);
+        return value;
+    }
+
+    std::any visitThisExpr(ThisExpr *) override {
+        return OTHER;
+    }
+
+    std::any visitSuperExpr(SuperExpr *) override {
+        return OTHER;
+    }
+
+    std::any visitArrayExpr(ArrayExpr *expr) override {
+        for (auto element : expr->elements) check(element);
+        return OTHER;
+    }
+
+    std::any visitIndexExpr(IndexExpr *expr) override {
+        check(expr->object);
+        check(expr->index);
+        return ANY;
+    }
+
+    std::any visitIndexSetExpr(IndexSetExpr *expr) override {
+        check(expr->object);
+        check(expr->index);
+        return check(expr->value);
+    }
+
+    std::any visitSpawnExpr(SpawnExpr *expr) override {
+        check(expr->call);
+        return OTHER;
+    }
+
+    std::any visitAwaitExpr(AwaitExpr *expr) override {
+        check(expr->task);
+        return ANY;
+    }
+
+    std::any visitCompoundAssignExpr(CompoundAssignExpr *expr) override {
+        Types value = binary(expr->Operator.type, slot(expr->slot), literal(expr->constant), expr->operands);
+        set(expr->slot, value);
+        return value;
+    }
+
+    std::any visitVarLiteralExpr(VarLiteralExpr *expr) override {
+        Types variable = slot(expr->slot), constant = literal(expr->constant);
+        if (expr->literalFirst) return binary(expr->Operator.type, constant, variable, expr->operands);
+        return binary(expr->Operator.type, variable, constant, expr->operands);
+    }
+
+    std::any visitVarVarExpr(VarVarExpr *expr) override {
+        return binary(expr->Operator.type, slot(expr->leftSlot), slot(expr->rightSlot), expr->operands);
+    }
+
+    /* Statements */
+
+    void visitExpressionStmt(ExpressionStmt *stmt) override {
+        check(stmt->expression);
+    }
+
+    void visitPrintStmt(PrintStmt *stmt) override {
+        check(stmt->expression);
+    }
+
+    void visitVarStmt(VarStmt *stmt) override {
+        set(stmt->slot, stmt->initializer ? check(stmt->initializer) : NIL);
+    }
+
+    void visitBlockStmt(BlockStmt *stmt) override {
+        check(stmt->statements);
+    }
+
+    void visitFunStmt(FunStmt *stmt) override {
+        set(stmt->slot, OTHER);
+        checkFunction(stmt);
+    }
+
+    void visitReturnStmt(ReturnStmt *stmt) override {
+        if (stmt->value) check(stmt->value);
+        reachable = false;
+    }
+
+    void visitIfStmt(IfStmt *stmt) override {
+        check(stmt->condition);
+
+        std::vector<Types> before = slots;
+        bool reachableBefore = reachable;
+
+        check(stmt->thenBranch);
+        std::vector<Types> thenSlots = std::move(slots);
+        bool thenReachable = reachable;
+
+        slots = std::move(before);
+        reachable = reachableBefore;
+        check(stmt->elseBranch);
+
+        join(thenSlots, thenReachable);
+    }
+
+    void visitWhileStmt(WhileStmt *stmt) override {
+        // the types at the top of the loop, before the condition
+        std::vector<Types> head = slots;
+        bool headReachable = reachable;
+
+        widening++;
+        while (true) {
+            slots = head;
+            reachable = headReachable;
+            trip(stmt);
+
+            // the back edge joins the end of the trip into the top
+            std::vector<Types> end = std::move(slots);
+            bool endReachable = reachable;
+            slots = head;
+            reachable = headReachable;
+            join(end, endReachable);
+
+            if (slots == head) break;
+            head = slots;
+        }
+        widening--;
+
+        slots = head;
+        reachable = headReachable;
+        check(stmt->condition);
+
+        // the loop is left when the condition fails, with the types it saw
+        std::vector<Types> exit = slots;
+        trip(stmt, false);
+
+        slots = std::move(exit);
+        reachable = headReachable;
+    }
+
+    void visitClassStmt(ClassStmt *stmt) override {
+        if (stmt->superclass) check(stmt->superclass);
+        set(stmt->slot, OTHER);
+
+        for (auto method : stmt->methods) checkFunction(method);
+    }
+};
@@ -0,0 +1,52 @@
+#include "../include/bench.hpp"
+
+#ifndef HD_BENCH_CORPUS
+#define HD_BENCH_CORPUS "bench/corpus"
+#endif
+
+int main(int argc, char* argv[]) {
+
+    Bench bench;
+    size_t generated = 200000;
+    size_t loops = 1000000;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--json") bench.json = true;
+        else if (arg == "--warmup" && i + 1 < argc) bench.warmup = std::stoi(argv[++i]);
+        else if (arg == "--reps" && i + 1 < argc) bench.repetitions = std::stoi(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc) bench.filter = argv[++i];
+        else if (arg == "--generated" && i + 1 < argc) generated = std::stoul(argv[++i]);
+        else if (arg == "--loops" && i + 1 < argc) loops = std::stoul(argv[++i]);
+        else if (arg == "--scan-threads" && i + 1 < argc) bench.scanThreads = std::stoul(argv[++i]);
+        else if (arg == "--fuel" && i + 1 < argc) bench.maxFuel = std::stoull(argv[++i]);
+        else if (arg == "--max-heap" && i + 1 < argc) bench.maxHeap = std::stoull(argv[++i]);
+        else if (arg.rfind("--", 0) == 0) {
+            std::cout << "Usage: bench [--json] [--warmup n] [--reps n] [--filter name] [--generated statements] [--loops iterations] [--scan-threads n] [--fuel n] [--max-heap bytes] [script...]\n";
+            return 64;
+        }
+        else files.push_back(arg);
+    }
+
+    Heap::tracking = bench.maxHeap != 0;
+
+    if (files.empty()) {
+        bench.addCorpus(HD_BENCH_CORPUS);
+        if (generated > 0) bench.addGenerated(generated);
+        bench.addLibrary(5000);
+        if (loops > 0) bench.addLoops(loops);
+    } else {
+        for (auto& file : files) bench.addFile(file);
+    }
+
+    auto results = bench.run();
+    bench.report(results, std::cout);
+
+    for (auto& result : results) {
+        if (result.failed) return 1;
+    }
+
+    return 0;
+}
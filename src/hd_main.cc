@@ -1,18 +1,60 @@
 #include "../include/hd.hpp"
 
+int usage() {
+    std::cout << "Usage: hd [--profile] [--flamegraph file] [--stats[=json]] [--perf-counters] [--max-call-depth n] [--no-fuse] [--no-lazy] [--no-dce] [--stream] [--scan-threads n] [--fuel n] [--max-heap bytes] [--emit-cpp] [script]\n";
+    return 64;
+}
+
 int main(int argc, char* argv[]) {
     
     HD hd;
 
-    if (argc > 2) {
-        std::cout << "Usage: jlox [script]\n";
+    bool profile = false;
+    std::string stats;
+    bool perfCounters = false;
+    std::string flamegraph;
+    bool emitCpp = false;
+    bool metered = false;
+    std::string script;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--profile") profile = true;
+        else if (arg == "--flamegraph" && i + 1 < argc) { profile = true; flamegraph = argv[++i]; }
+        else if (arg == "--stats" || arg == "--stats=json") stats = arg;
+        else if (arg == "--perf-counters") perfCounters = true;
+        else if (arg == "--max-call-depth" && i + 1 < argc) hd.setMaxCallDepth(std::stoul(argv[++i]));
+        else if (arg == "--no-fuse") hd.setFusion(false);
+        else if (arg == "--no-lazy") hd.setLazyParsing(false);
+        else if (arg == "--no-dce") hd.setDeadCodeElimination(false);
+        else if (arg == "--stream") hd.setStreaming(true);
+        else if (arg == "--scan-threads" && i + 1 < argc) hd.setScanThreads(std::stoul(argv[++i]));
+        else if (arg == "--fuel" && i + 1 < argc) { metered = true; hd.setFuel(std::stoull(argv[++i])); }
+        else if (arg == "--max-heap" && i + 1 < argc) { metered = true; hd.setMaxHeap(std::stoull(argv[++i])); }
+        else if (arg == "--emit-cpp") emitCpp = true;
+        else if (arg.rfind("--", 0) == 0 || !script.empty()) return usage();
+        else script = arg;
+    }
+
+    if (profile) hd.enableProfiling(flamegraph);
+    if (perfCounters) hd.enablePerfCounters();
+    if (!stats.empty()) hd.enableStats(stats == "--stats=json");
+
+    // there is nothing to translate at the prompt
+    if (emitCpp && script.empty()) return usage();
+
+    // the translated program has no fuel or heap checks, it would silently run unlimited
+    if (emitCpp && metered) {
+        std::cerr << "--fuel and --max-heap can't be used with --emit-cpp\n";
         return 64;
     }
+    hd.setEmitCpp(emitCpp);
 
-    if (argc == 2) {
-        return hd.runFile(argv[1]);
+    if (!script.empty()) {
+        return hd.runFile(script);
     } else {
         return hd.runPrompt();
     }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Compares hd --emit-cpp against the interpreter on a set of scripts.
+
+    aot_bench.py <hd> <include dir> <generated headers dir> [script.lox ...]
+
+Each script is translated with hd --emit-cpp, built with $CXX (c++ when it
+is not set) and then run both ways. The native program must print exactly
+what the interpreter prints, to stdout and stderr, and exit with the same
+status, otherwise the script counts as failed. Timings are the best of
+$HD_AOT_RUNS runs (3 by default). Without scripts the benchmark corpus in
+bench/corpus is used. Meson runs this as the 'aot' benchmark, see
+src/meson.build.
+"""
+
+import glob
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def run(command):
+    start = time.perf_counter()
+    result = subprocess.run(command, capture_output=True)
+    return time.perf_counter() - start, result
+
+
+def best(command, runs):
+    times, result = [], None
+    for _ in range(runs):
+        elapsed, result = run(command)
+        times.append(elapsed)
+    return min(times), result
+
+
+def main():
+    if len(sys.argv) < 4:
+        print('Usage: aot_bench.py <hd> <include dir> <generated headers dir> [script.lox ...]', file=sys.stderr)
+        return 64
+
+    hd, include, generated = (os.path.abspath(path) for path in sys.argv[1:4])
+    scripts = sys.argv[4:]
+    if not scripts:
+        root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+        scripts = sorted(glob.glob(os.path.join(root, 'bench', 'corpus', '*.lox')))
+
+    cxx = shlex.split(os.environ.get('CXX', 'c++'))
+    runs = int(os.environ.get('HD_AOT_RUNS', '3'))
+    failed = 0
+
+    print(f'{"script":<20} {"interpreter":>12} {"native":>12} {"speedup":>8} {"build":>8}')
+
+    with tempfile.TemporaryDirectory() as work:
+        for script in scripts:
+            name = os.path.splitext(os.path.basename(script))[0]
+            source = os.path.join(work, name + '.cc')
+            binary = os.path.join(work, name)
+
+            emitted = subprocess.run([hd, '--emit-cpp', script], capture_output=True)
+            if emitted.returncode != 0:
+                print(f'{name:<20} emit failed:\n{emitted.stderr.decode()}', file=sys.stderr)
+                failed += 1
+                continue
+
+            with open(source, 'wb') as file:
+                file.write(emitted.stdout)
+
+            build, built = run(cxx + ['-std=c++17', '-O2', '-DNDEBUG', '-I' + include, '-I' + generated,
+                                      '-pthread', source, '-o', binary])
+            if built.returncode != 0:
+                print(f'{name:<20} build failed:\n{built.stderr.decode()}', file=sys.stderr)
+                failed += 1
+                continue
+
+            interpreted, expected = best([hd, script], runs)
+            native, actual = best([binary], runs)
+
+            if (actual.stdout, actual.stderr, actual.returncode) != (expected.stdout, expected.stderr, expected.returncode):
+                print(f'{name:<20} output differs from the interpreter', file=sys.stderr)
+                failed += 1
+                continue
+
+            print(f'{name:<20} {interpreted * 1000:>10.1f}ms {native * 1000:>10.1f}ms '
+                  f'{interpreted / native:>7.2f}x {build:>7.1f}s')
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,341 @@
+#!/usr/bin/env python3
+"""
+Generates token_type.hpp, expression.hpp and statement.hpp from ast.def.
+
+    gen_ast.py <ast.def> <output directory>
+
+Meson runs this at build time, see src/meson.build. The format of the
+definition file is described at the top of include/ast.def.
+"""
+
+import os
+import sys
+
+
+class Field:
+    def __init__(self, type, name, default, comments, owned):
+        self.type = type
+        self.name = name
+        self.default = default
+        self.comments = comments
+        self.owned = owned
+
+
+class Node:
+    def __init__(self, family, name, comments):
+        self.family = family
+        self.name = name
+        self.comments = comments
+        self.params = []
+        self.annotations = []
+
+    @property
+    def cls(self):
+        return self.name + self.family.base
+
+
+class Family:
+    def __init__(self, base, file, result, includes):
+        self.base = base
+        self.file = file
+        self.result = result
+        self.includes = includes
+        self.prelude = []
+        self.nodes = []
+
+
+FAMILIES = {
+    "expr": Family("Expr", "expression.hpp", "std::any", ["tokens.hpp", "stats.hpp"]),
+    "stmt": Family("Stmt", "statement.hpp", "void", ["tokens.hpp", "expression.hpp", "stats.hpp"]),
+}
+
+# alignment of the member types nodes use, members are laid out largest
+# alignment first so the compiler has no padding to insert between them
+ALIGN = {"Mark": 4, "int": 4, "bool": 1, "FunctionKind": 4, "Operands": 1}
+
+
+def fail(path, number, message):
+    sys.exit(f"{path}:{number}: {message}")
+
+
+def split_field(text):
+    """'Expr *left = nullptr' -> ('Expr *', 'left', 'nullptr')"""
+    default = None
+    if "=" in text:
+        text, default = (part.strip() for part in text.split("=", 1))
+
+    cut = max(text.rfind(" "), text.rfind("*"), text.rfind(">"))
+    type, name = text[:cut + 1].strip(), text[cut + 1:].strip()
+    if type.endswith("*"):
+        type = type[:-1].rstrip() + " *"
+    return type, name, default
+
+
+def is_node_pointer(type):
+    return type.endswith("*") and type[:-1].strip().endswith(("Expr", "Stmt"))
+
+
+def is_node_vector(type):
+    return type.startswith("std::vector<") and type.endswith(("Expr*>", "Stmt*>"))
+
+
+def trivial(type):
+    return type.endswith("*") or type in ALIGN
+
+
+def alignment(type):
+    return ALIGN.get(type, 8)
+
+
+def parse(path):
+    tokens = []
+    comments = []
+    node = None
+    prelude = None
+    annotating = False
+
+    with open(path) as source:
+        lines = source.read().splitlines()
+
+    for number, raw in enumerate(lines, 1):
+        line = raw.strip()
+        indented = raw[:1].isspace()
+
+        if raw.startswith("#"):
+            continue
+
+        if prelude is not None and (indented or not line):
+            prelude.append(raw[4:] if raw.startswith("    ") else line)
+            continue
+
+        if not line:
+            comments = []
+            continue
+
+        if line.startswith("//"):
+            comments.append(line)
+            continue
+
+        if not indented:
+            words = line.split()
+            node, prelude, annotating = None, None, False
+
+            if words == ["tokens"]:
+                node = "tokens"
+            elif len(words) == 2 and words[0] == "prelude" and words[1] in FAMILIES:
+                prelude = FAMILIES[words[1]].prelude
+            elif len(words) == 2 and words[0] in FAMILIES:
+                family = FAMILIES[words[0]]
+                node = Node(family, words[1], comments)
+                family.nodes.append(node)
+            else:
+                fail(path, number, f"unknown section '{line}'")
+
+            comments = []
+            continue
+
+        if node is None:
+            fail(path, number, "indented line outside a section")
+
+        if node == "tokens":
+            words = line.split()
+            if len(words) > 3 or (len(words) == 3 and words[2] != "keyword"):
+                fail(path, number, f"bad token '{line}'")
+            tokens.append((words[0], words[1] if len(words) > 1 else "", len(words) == 3, comments))
+            comments = []
+            continue
+
+        if line == "---":
+            annotating = True
+            comments = []
+            continue
+
+        type, name, default = split_field(line)
+        if not type or not name:
+            fail(path, number, f"bad field '{line}'")
+
+        if annotating:
+            node.annotations.append(Field(type, name, default, comments, False))
+        else:
+            owned = is_node_pointer(type) or is_node_vector(type)
+            node.params.append(Field(type, name, default, comments, owned))
+        comments = []
+
+    for family in FAMILIES.values():
+        while family.prelude and not family.prelude[-1]:
+            family.prelude.pop()
+
+    return tokens
+
+
+def cpp_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def token_header(tokens):
+    out = ["#pragma once", "", "#include <cstddef>", "#include <cstdint>", "", "// generated by tools/gen_ast.py from include/ast.def", ""]
+
+    out.append("enum class TokenType : uint8_t {")
+    for name, _, _, comments in tokens:
+        if comments and out[-1] != "enum class TokenType : uint8_t {":
+            out.append("")
+            out.extend("    " + c for c in comments)
+        out.append(f"    {name},")
+    out.append("")
+    out.append("    __COUNT")
+    out.append("};")
+    out.append("")
+
+    out.append("constexpr const char *TOKEN_NAMES[] = {")
+    out.extend(f"    {cpp_string(name)}," for name, _, _, _ in tokens)
+    out.append("};")
+    out.append("")
+
+    out.append("// the fixed text of each token, empty for identifiers, literals and the end of input")
+    out.append("constexpr const char *TOKEN_SPELLINGS[] = {")
+    out.extend(f"    {cpp_string(spelling)}," for _, spelling, _, _ in tokens)
+    out.append("};")
+    out.append("")
+
+    keywords = [(spelling, name) for name, spelling, keyword, _ in tokens if keyword]
+    out.append("struct Keyword {")
+    out.append("    const char *text;")
+    out.append("    TokenType type;")
+    out.append("};")
+    out.append("")
+    out.append("constexpr Keyword KEYWORDS[] = {")
+    out.extend(f"    {{ {cpp_string(text)}, TokenType::{name} }}," for text, name in keywords)
+    out.append("};")
+    out.append("")
+
+    out.append("static_assert(sizeof(TOKEN_NAMES) / sizeof(*TOKEN_NAMES) == static_cast<size_t>(TokenType::__COUNT));")
+    out.append("")
+    out.append("constexpr const char *toString(TokenType type) {")
+    out.append("    return TOKEN_NAMES[static_cast<size_t>(type)];")
+    out.append("}")
+    out.append("")
+    out.append("constexpr const char *spelling(TokenType type) {")
+    out.append("    return TOKEN_SPELLINGS[static_cast<size_t>(type)];")
+    out.append("}")
+
+    return out
+
+
+def node_header(family):
+    base = family.base
+    out = ["#pragma once", "", "#include <any>", "#include <utility>", "#include <vector>", ""]
+    out.extend(f'#include "{include}"' for include in family.includes)
+    out.append("")
+    out.append("// generated by tools/gen_ast.py from include/ast.def")
+    out.append("")
+
+    out.append(f"class {base};")
+    out.extend(f"class {node.cls};" for node in family.nodes)
+    out.append("")
+    out.extend(family.prelude)
+    if family.prelude:
+        out.append("")
+
+    visitor = f"{base}Visitor"
+    arg = base.lower()
+    out.append(f"class {visitor} {{")
+    out.append("public:")
+    out.append(f"    virtual ~{visitor}() {{}}")
+    for node in family.nodes:
+        out.append(f"    virtual {family.result} visit{node.cls}({node.cls} *{arg}) = 0;")
+    out.append("};")
+    out.append("")
+
+    out.append("// variables are intentionally public")
+    out.append("// nodes own their children and delete them on destruction")
+    out.append("")
+    out.append(f"class {base} {{")
+    out.append("public:")
+    out.append(f"    {base}() {{ HD_STAT({arg}Nodes); }}")
+    out.append(f"    virtual ~{base}() {{}}")
+    out.append("")
+    out.append(f"    virtual {family.result} accept({visitor} *visitor) = 0;")
+    out.append("};")
+
+    for node in family.nodes:
+        out.append("")
+        out.extend(node.comments)
+        out.extend(node_class(family, node))
+
+    return out
+
+
+def node_class(family, node):
+    out = [f"class {node.cls} : public {family.base} {{", "public:"]
+
+    params = ", ".join(f"{f.type}{'' if f.type.endswith('*') else ' '}{f.name}" + (f" = {f.default}" if f.default else "")
+                       for f in node.params)
+    members = layout(node)
+    inits = ", ".join(f"{f.name}({f.name})" if trivial(f.type) else f"{f.name}(std::move({f.name}))"
+                      for f in members if f in node.params)
+    out.append(f"    {node.cls}({params})" + (f" : {inits}" if inits else "") + " {}")
+
+    owned = []
+    for f in node.params:
+        if not f.owned:
+            continue
+        if f.type.startswith("std::vector"):
+            owned.append(f"for (auto child : {f.name}) delete child;")
+        else:
+            owned.append(f"delete {f.name};")
+    if owned:
+        out.append(f"    ~{node.cls}() {{ {' '.join(owned)} }}")
+
+    out.append("")
+    out.append(f"    {family.result} accept({family.base}Visitor *visitor) override {{")
+    out.append(f"        {'' if family.result == 'void' else 'return '}visitor->visit{node.cls}(this);")
+    out.append("    }")
+    out.append("")
+    out.append("public:")
+
+    for f in members:
+        if f.comments and out[-1] != "public:":
+            out.append("")
+        out.extend("    " + c for c in f.comments)
+        init = f" = {f.default}" if f.default and f not in node.params else ""
+        space = "" if f.type.endswith("*") else " "
+        out.append(f"    {f.type}{space}{f.name}{init};")
+
+    out.append("};")
+    return out
+
+
+def layout(node):
+    # stable, so fields of the same alignment keep the order they were written in
+    return sorted(node.params + node.annotations, key=lambda f: -alignment(f.type))
+
+
+def write(directory, name, lines):
+    text = "\n".join(lines) + "\n"
+    path = os.path.join(directory, name)
+
+    # leave the file alone when nothing changed, so dependants are not rebuilt
+    if os.path.exists(path):
+        with open(path) as existing:
+            if existing.read() == text:
+                return
+
+    with open(path, "w") as out:
+        out.write(text)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(f"usage: {sys.argv[0]} <ast.def> <output directory>")
+
+    definition, directory = sys.argv[1:]
+    tokens = parse(definition)
+
+    os.makedirs(directory, exist_ok=True)
+    write(directory, "token_type.hpp", token_header(tokens))
+    for family in FAMILIES.values():
+        write(directory, family.file, node_header(family))
+
+
+if __name__ == "__main__":
+    main()